@@ -1,26 +1,37 @@
 #include "lexer.hpp"
 #include "parser.hpp"
 #include "compiler.hpp"
+#include "optimiser.hpp"
+#include "peephole.hpp"
+#include "ir.hpp"
 #include "runtime.hpp"
 #include "utility/print.hpp"
 
+#include <cctype>
+#include <filesystem>
 #include <string>
 
 void print_usage()
 {
-    anzu::print("usage: anzu.exe <program_file> <option>\n\n");
+    anzu::print("usage: anzu.exe <program_file> <option> [flags]\n\n");
     anzu::print("The Anzu Programming Language\n\n");
     anzu::print("options:\n");
     anzu::print("    lex   - runs the lexer and prints the tokens\n");
     anzu::print("    parse - runs the parser and prints the AST\n");
     anzu::print("    com   - runs the compiler and prints the bytecode\n");
+    anzu::print("    ir    - runs the compiler and prints the intermediate representation\n");
     anzu::print("    debug - runs the program and prints each op code executed\n");
-    anzu::print("    run   - runs the program\n");
+    anzu::print("    run   - runs the program\n\n");
+    anzu::print("flags:\n");
+    anzu::print("    -O<n>     - sets the optimisation level, defaults to -O0\n");
+    anzu::print("    --reg     - uses register ops for variables where possible\n");
+    anzu::print("    --checked - checks list subscripts are in range at runtime\n");
+    anzu::print("    --aligned - gives struct fields and heap blocks their natural alignment\n");
 }
 
 auto main(const int argc, const char* argv[]) -> int
 {
-    if (argc != 3) {
+    if (argc < 3) {
         print_usage();
         return 1;
     }
@@ -28,6 +39,27 @@ auto main(const int argc, const char* argv[]) -> int
     const auto file = std::string{argv[1]};
     const auto mode = std::string{argv[2]};
 
+    auto opt_level = 0;
+    auto use_registers = false;
+    auto check_bounds = false;
+    auto aligned_layout = false;
+    for (int i = 3; i != argc; ++i) {
+        const auto flag = std::string{argv[i]};
+        if (flag.starts_with("-O") && flag.size() == 3 && std::isdigit(flag[2])) {
+            opt_level = flag[2] - '0';
+        } else if (flag == "--reg") {
+            use_registers = true;
+        } else if (flag == "--checked") {
+            check_bounds = true;
+        } else if (flag == "--aligned") {
+            aligned_layout = true;
+        } else {
+            anzu::print("unknown flag: '{}'\n", flag);
+            print_usage();
+            return 1;
+        }
+    }
+
     anzu::print("Loading file '{}'\n", file);
     anzu::print("-> Lexing\n");
     const auto tokens = anzu::lex(file);
@@ -37,18 +69,53 @@ auto main(const int argc, const char* argv[]) -> int
     }
 
     anzu::print("-> Parsing\n");
-    const auto ast = anzu::parse(tokens);
+    auto ast = anzu::parse(tokens);
+    if (opt_level > 0) {
+        anzu::print("-> Optimising\n");
+        anzu::optimise(ast, opt_level, aligned_layout);
+    }
     if (mode == "parse") {
         print_node(*ast);
         return 0;
     }
 
     anzu::print("-> Compiling\n");
-    const auto program = anzu::compile(ast);
+    auto program = anzu::compile(ast, {
+        .evaluate_pure_calls = opt_level > 0,
+        .hoist_loop_invariants = opt_level > 0,
+        .check_bounds = check_bounds,
+        .reuse_stack_slots = opt_level > 0,
+        .aligned_layout = aligned_layout,
+        .source_dir = std::filesystem::path{file}.parent_path()
+    });
+    if (opt_level > 0) {
+        auto removed = anzu::peephole(program);
+        try {
+            auto ir = anzu::lift(program);
+            removed += anzu::eliminate_dead_code(ir);
+            program = anzu::lower(ir);
+        } catch (const anzu::lift_error& e) {
+            anzu::print("-> Skipping IR passes, could not lift program: {}\n", e.what());
+        }
+        anzu::print("-> Optimising bytecode ({} ops removed)\n", removed);
+    }
+    if (use_registers) {
+        const auto removed = anzu::select_register_ops(program);
+        anzu::print("-> Selecting register ops ({} ops removed)\n", removed);
+    }
     if (mode == "com") {
         anzu::print_program(program);
         return 0;
     }
+    if (mode == "ir") {
+        try {
+            anzu::print_ir(anzu::lift(program));
+        } catch (const anzu::lift_error& e) {
+            anzu::print("[ERROR] (ir) {}\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
 
     anzu::print("-> Running\n\n");
     if (mode == "run") {
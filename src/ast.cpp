@@ -39,6 +39,9 @@ auto print_node(const node_expr& root, int indent) -> void
         },
         [&](const node_function_call_expr& node) {
             print("{}FunctionCall: {}\n", spaces, node.function_name);
+            if (!node.templates.empty()) {
+                print("{}- Templates: {}\n", spaces, format_comma_separated(node.templates));
+            }
             print("{}- Args:\n", spaces);
             for (const auto& arg : node.args) {
                 print_node(*arg, indent + 1);
@@ -85,6 +88,15 @@ auto print_node(const node_expr& root, int indent) -> void
             print("{}- Index:\n", spaces);
             print_node(*node.index, indent + 1);
         },
+        [&](const node_slice_expr& node) {
+            print("{}Slice:\n", spaces);
+            print("{}- Expr:\n", spaces);
+            print_node(*node.expr, indent + 1);
+            print("{}- Lower:\n", spaces);
+            print_node(*node.lower, indent + 1);
+            print("{}- Upper:\n", spaces);
+            print_node(*node.upper, indent + 1);
+        },
         [&](const node_new_expr& node) {
             print("{}New {}:\n", spaces, node.type);
             print("{}- Size:\n", spaces);
@@ -124,6 +136,7 @@ auto print_node(const node_stmt& root, int indent) -> void
         [&](const node_struct_stmt& node) {
             print("{}Struct:\n", spaces);
             print("{}- Name: {}\n", spaces, node.name);
+            print("{}- Soa: {}\n", spaces, node.is_soa);
             print("{}- Fields:\n", spaces);
             for (const auto& field : node.fields) {
                 print("{}  - {}: {}\n", spaces, field.name, field.type);
@@ -153,7 +166,7 @@ auto print_node(const node_stmt& root, int indent) -> void
             print_node(*node.expr, indent + 1);
         },
         [&](const node_function_def_stmt& node) {
-            print("{}Function: {} (", spaces, node.name);
+            print("{}Function: {}{}{} (", spaces, node.is_inline ? "inline " : "", node.is_memo ? "memo " : "", node.name);
             print_comma_separated(node.sig.params, [](const auto& arg) {
                 return std::format("{}: {}", arg.name, arg.type);
             });
@@ -161,7 +174,7 @@ auto print_node(const node_stmt& root, int indent) -> void
             print_node(*node.body, indent + 1);
         },
         [&](const node_member_function_def_stmt& node) {
-            print("{}MemberFunction: {}::{} (", spaces, node.struct_name, node.function_name);
+            print("{}MemberFunction: {}{}::{} (", spaces, node.is_inline ? "inline " : "", node.struct_name, node.function_name);
             print_comma_separated(node.sig.params, [](const auto& arg) {
                 return std::format("{}: {}", arg.name, arg.type);
             });
@@ -52,6 +52,7 @@ struct node_binary_op_expr
 struct node_function_call_expr
 {
     std::string                function_name;
+    std::vector<type_name>     templates; // Type args, such as the i64 in vec<i64>()
     std::vector<node_expr_ptr> args;
 
     anzu::token token;
@@ -110,6 +111,16 @@ struct node_subscript_expr
     anzu::token token;
 };
 
+// Evaluates to a slice of the elements of a list or slice in the range [lower, upper)
+struct node_slice_expr
+{
+    node_expr_ptr expr;
+    node_expr_ptr lower;
+    node_expr_ptr upper;
+
+    anzu::token token;
+};
+
 struct node_new_expr
 {
     type_name     type;
@@ -130,6 +141,7 @@ struct node_expr : std::variant<
     node_addrof_expr,
     node_sizeof_expr,
     node_new_expr,
+    node_slice_expr,
 
     // Lvalue expressions
     node_variable_expr,
@@ -171,6 +183,7 @@ struct node_struct_stmt
     std::string                name;
     type_fields                fields;
     std::vector<node_stmt_ptr> functions;
+    bool                       is_soa = false; // Lists of this type store each field contiguously
 
     anzu::token token;
 };
@@ -206,6 +219,8 @@ struct node_function_def_stmt
     std::string   name;
     signature     sig;
     node_stmt_ptr body;
+    bool          is_inline = false; // Hint to inline calls regardless of size
+    bool          is_memo = false;   // Cache the results of calls, the function must be pure
 
     anzu::token token;
 };
@@ -216,6 +231,7 @@ struct node_member_function_def_stmt
     std::string   function_name;
     signature     sig;
     node_stmt_ptr body;
+    bool          is_inline = false; // Hint to inline calls regardless of size
 
     anzu::token token;
 };
@@ -1,17 +1,27 @@
 #include "compiler.hpp"
 #include "lexer.hpp"
+#include "vocabulary.hpp"
 #include "object.hpp"
 #include "parser.hpp"
 #include "functions.hpp"
 #include "operators.hpp"
+#include "runtime.hpp"
 #include "utility/print.hpp"
 #include "utility/overloaded.hpp"
 #include "utility/views.hpp"
-
+#include "utility/memory.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
 #include <string_view>
 #include <optional>
 #include <tuple>
 #include <vector>
+#include <span>
 #include <stack>
 #include <unordered_map>
 #include <unordered_set>
@@ -52,6 +62,7 @@ struct var_scope
 
     scope_type type;
     std::unordered_map<std::string, var_info> vars;
+    std::size_t padding = 0; // Gaps left to align the variables
 };
 
 class var_locations
@@ -89,9 +100,19 @@ public:
         d_scopes.emplace_back(type);
     }
 
+    // Leaves a gap in the current scope so that the next variable starts at a multiple of the
+    // alignment. Returns the size of the gap.
+    auto pad_to(std::size_t alignment) -> std::size_t
+    {
+        const auto padding = align_up(d_next, alignment) - d_next;
+        d_scopes.back().padding += padding;
+        d_next += padding;
+        return padding;
+    }
+
     auto pop_scope() -> std::size_t // Returns the size of the scope just popped
     {
-        auto scope_size = std::size_t{0};
+        auto scope_size = d_scopes.back().padding;
         for (const auto& [name, info] : d_scopes.back().vars) {
             scope_size += info.type_size;
         }
@@ -100,6 +121,20 @@ public:
         return scope_size;
     }
 
+    // Replaces a variable in the current scope with a new one of the same size in its slot
+    auto reuse(const std::string& old_name, const std::string& name, const type_name& type) -> bool
+    {
+        auto& vars = d_scopes.back().vars;
+        const auto old = vars.find(old_name);
+        if (old == vars.end() || vars.contains(name)) {
+            return false;
+        }
+        const auto info = var_info{ .location=old->second.location, .type=type, .type_size=old->second.type_size };
+        vars.erase(old);
+        vars.emplace(name, info);
+        return true;
+    }
+
     auto current_scope() const -> const var_scope&
     {
         return d_scopes.back();
@@ -134,10 +169,63 @@ struct function_val
     token       tok;
 };
 
+struct inline_param
+{
+    std::size_t uses = 0;
+    bool        needs_lvalue = false; // Used as the base of a field or subscript
+};
+
+// A function whose body is a single return statement can be inlined by compiling its return
+// expression at the call site, with each parameter replaced by its argument expression.
+struct inline_info
+{
+    const node_expr*          expr;
+    std::vector<inline_param> params;
+};
+
+struct inline_arg
+{
+    const node_expr* expr;
+    bool             is_addrof; // For the self parameter of member functions
+    type_name        type;
+};
+
+using inline_frame = std::unordered_map<std::string, inline_arg>;
+
+// Return expressions larger than this many nodes are only inlined if the function has the
+// inline hint.
+constexpr auto inline_threshold = std::size_t{10};
+
+// Variables whose address may be taken in a function. Member calls and slicing only take the
+// address of variables that are not vecs, since vec member functions do not keep the pointer and
+// a vec's elements live on the heap, so these are kept apart until the variable's type is known.
+struct aliased_vars
+{
+    std::unordered_set<std::string> address_taken;
+    std::unordered_set<std::string> unless_vec;
+};
+
 struct current_function
 {
     var_locations vars;
     type_name     return_type;
+
+    // Variables whose address is taken anywhere in the function, found before compiling it.
+    // These may be written through pointers, so can be modified other than by name. Their slots
+    // are not reused, and while one is in scope returned calls cannot reuse the frame.
+    aliased_vars aliased;
+
+    // Set if the function is memoised, results are stored in the cache before returning
+    std::optional<std::size_t> memo_id;
+};
+
+// A variable known to be less than a bound, established by the condition of an enclosing while
+// or if statement and not modified since. Used to remove bounds checks that cannot fail.
+struct range_fact
+{
+    std::string name;
+    std::size_t bound;
+    const void* owner; // The statement whose condition established the fact
 };
 
 struct control_flow_frame
@@ -151,11 +239,32 @@ struct control_flow_frame
 struct compiler
 {
     program program;
+    compile_options options;
 
     using function_hash = decltype([](const function_key& f) { return hash(f); });
     std::unordered_map<function_key, function_val, function_hash> functions;
     std::unordered_set<std::string> function_names;
 
+    // Functions that calls can be inlined for, and the parameter substitutions for the calls
+    // currently being inlined.
+    std::unordered_map<function_key, inline_info, function_hash> inline_functions;
+    std::vector<inline_frame> inline_frames;
+
+    // The positions of functions that are pure, and the number of memoised functions
+    std::unordered_set<std::size_t> pure_functions;
+    std::size_t                     memo_count = 0;
+
+    // Loop invariant expressions in the loops currently being compiled, and the hidden variables
+    // holding their values, which are used in their place.
+    std::unordered_map<const node_expr*, node_variable_expr> hoisted_exprs;
+    std::size_t                                               hoisted_count = 0;
+
+    std::vector<range_fact> range_facts;
+
+    // A variable in the current scope that is not used after the declaration being compiled,
+    // whose slot the declaration may take over.
+    std::optional<std::string> reusable_slot;
+
     var_locations globals;
     std::optional<current_function> current_func;
 
@@ -176,7 +285,13 @@ template <typename T>
 auto push_literal(compiler& com, const T& value) -> void
 {
     const auto bytes = as_bytes(value);
-    com.program.emplace_back(op_load_bytes{{bytes.begin(), bytes.end()}});
+    com.program.code.emplace_back(op_load_bytes{{bytes.begin(), bytes.end()}});
+}
+
+// Pushes zeroed bytes to fill the gaps between the fields of aligned structs
+auto push_padding(compiler& com, std::size_t size) -> void
+{
+    com.program.code.emplace_back(op_load_bytes{std::vector<std::byte>(size)});
 }
 
 auto current_vars(compiler& com) -> var_locations&
@@ -192,8 +307,42 @@ auto verify_real_type(const compiler& com, const token& tok, const type_name& t)
 template <typename T>
 auto append_op(compiler& com, T&& op) -> std::size_t
 {
-    com.program.emplace_back(std::forward<T>(op));
-    return com.program.size() - 1;
+    com.program.code.emplace_back(std::forward<T>(op));
+    return com.program.code.size() - 1;
+}
+
+// In the aligned layout, every variable and param of the given type starts at a multiple of
+// this from the start of its frame, which is at least 8 bytes and more for wide SIMD types.
+// Frames are aligned at runtime to the largest slot alignment, so each slot is at an aligned
+// address.
+auto slot_alignment(const compiler& com, const type_name& type) -> std::size_t
+{
+    return com.options.aligned_layout ? std::max(sizeof(std::uint64_t), com.types.align_of(type)) : 1;
+}
+
+auto type_of_expr(const compiler& com, const node_expr& node) -> type_name;
+
+// Pushes the padding needed before the next variable declared in the current scope, which will
+// hold the value of the given expression
+auto align_next_var(compiler& com, const node_expr& expr) -> std::size_t
+{
+    if (!com.options.aligned_layout) return 0;
+    const auto padding = current_vars(com).pad_to(slot_alignment(com, type_of_expr(com, expr)));
+    if (padding > 0) {
+        push_padding(com, padding);
+    }
+    return padding;
+}
+
+// Pushes the padding needed before an arg of the given type that would start at the given offset
+// in the frame of the callee, and returns the offset that the arg starts at instead.
+auto align_next_arg(compiler& com, std::size_t offset, const type_name& type) -> std::size_t
+{
+    const auto aligned = align_up(offset, slot_alignment(com, type));
+    if (aligned > offset) {
+        push_padding(com, aligned - offset);
+    }
+    return aligned;
 }
 
 // Registers the given name in the current scope
@@ -204,8 +353,22 @@ void declare_var(compiler& com, const token& tok, const std::string& name, const
     }
 }
 
+auto find_inline_arg(const compiler& com, const std::string& name) -> std::optional<inline_arg>
+{
+    if (!com.inline_frames.empty()) {
+        if (const auto it = com.inline_frames.back().find(name); it != com.inline_frames.back().end()) {
+            return it->second;
+        }
+    }
+    return std::nullopt;
+}
+
 auto get_var_type(const compiler& com, const token& tok, const std::string& name) -> type_name
 {
+    if (const auto arg = find_inline_arg(com, name); arg.has_value()) {
+        return arg->type;
+    }
+
     if (com.current_func) {
         auto& locals = com.current_func->vars;
         if (const auto info = locals.find(name); info.has_value()) {
@@ -226,14 +389,14 @@ auto push_var_addr(compiler& com, const token& tok, const std::string& name) ->
     if (com.current_func) {
         auto& locals = com.current_func->vars;
         if (const auto info = locals.find(name); info.has_value()) {
-            com.program.emplace_back(op_push_local_addr{ .offset=info->location });
+            com.program.code.emplace_back(op_push_local_addr{ .offset=info->location });
             return info->type;
         }
     }
 
     auto& globals = com.globals;
     if (const auto info = globals.find(name); info.has_value()) {
-        com.program.emplace_back(op_push_global_addr{ .position=info->location });
+        com.program.code.emplace_back(op_push_global_addr{ .position=info->location });
         return info->type;
     }
 
@@ -244,14 +407,14 @@ auto save_variable(compiler& com, const token& tok, const std::string& name) ->
 {
     const auto type = push_var_addr(com, tok, name);
     const auto size = com.types.size_of(type);
-    com.program.emplace_back(op_save{ .size=size });
+    com.program.code.emplace_back(op_save{ .size=size });
 }
 
 auto load_variable(compiler& com, const token& tok, const std::string& name) -> void
 {
     const auto type = push_var_addr(com, tok, name);
     const auto size = com.types.size_of(type);
-    com.program.emplace_back(op_load{ .size=size });
+    com.program.code.emplace_back(op_load{ .size=size });
 }
 
 // Returns the size of the parameter list in bytes + the function payload
@@ -260,7 +423,7 @@ auto signature_args_size(const compiler& com, const signature& sig) -> std::size
     // Function payload == old_base_ptr and old_prog_ptr
     auto args_size = 2 * sizeof(std::uint64_t);
     for (const auto& arg : sig.params) {
-        args_size += com.types.size_of(arg.type);
+        args_size = align_up(args_size, slot_alignment(com, arg.type)) + com.types.size_of(arg.type);
     }
     return args_size;
 }
@@ -273,14 +436,14 @@ auto compile_ptr_to_field(
 )
     -> type_name
 {
-    auto offset = std::size_t{0};
-    for (const auto& field : com.types.fields_of(type)) {
+    const auto fields = com.types.fields_of(type);
+    const auto offsets = com.types.offsets_of(type);
+    for (const auto& [field, offset] : zip(fields, offsets)) {
         if (field.name == field_name) {
             push_literal(com, offset);
-            com.program.emplace_back(op_modify_ptr{});
+            com.program.code.emplace_back(op_modify_ptr{});
             return field.type;
         }
-        offset += com.types.size_of(field.type);
     }
     
     compiler_error(tok, "could not find field '{}' for type '{}'\n", field_name, type);
@@ -325,6 +488,12 @@ auto call_destructor(compiler& com, const std::string& var, const type_name& typ
 {
     if (var.starts_with('#')) { return; } // Compiler intrinsic vars can be skipped
 
+    if (is_vec_type(type)) {
+        push_var_addr(com, {}, var);
+        com.program.code.emplace_back(op_vec_drop{});
+        return;
+    }
+
     const auto destructor_name = std::format("{}::drop", type);
     auto func_key = function_key{};
     func_key.name = destructor_name;
@@ -340,12 +509,13 @@ auto call_destructor(compiler& com, const std::string& var, const type_name& typ
         push_literal(com, std::uint64_t{0}); // prog ptr
         push_var_addr(com, tok, var);
 
-        com.program.emplace_back(op_function_call{
+        com.program.code.emplace_back(op_function_call{
             .name=destructor_name,
             .ptr=ptr + 1, // Jump into the function
-            .args_size=com.types.size_of(concrete_ptr_type(type)) + 2 * sizeof(std::uint64_t)
+            .args_size=com.types.size_of(concrete_ptr_type(type)) + 2 * sizeof(std::uint64_t),
+            .return_size=com.types.size_of(null_type())
         });
-        com.program.emplace_back(op_pop{ .size = com.types.size_of(null_type()) });
+        com.program.code.emplace_back(op_pop{ .size = com.types.size_of(null_type()) });
     }
 
     // TODO: Destruct the sub members of classes
@@ -393,6 +563,66 @@ auto destruct_on_return(compiler& com, const node_return_stmt* node = nullptr) -
     }
 }
 
+// Lists can be passed to functions that take slices of their elements
+auto is_convertible(const type_name& from, const type_name& to) -> bool
+{
+    return from == to
+        || ((is_list_type(from) || is_vec_type(from)) && is_slice_type(to) && inner_type(from) == inner_type(to));
+}
+
+// Returns the key of the function to call for the given name and arg types. If there is no
+// exact match, the function that the args can be converted for is used, if there is only one.
+auto find_function(const compiler& com, const function_key& key) -> std::optional<function_key>
+{
+    if (com.functions.contains(key)) {
+        return key;
+    }
+
+    auto found = std::optional<function_key>{};
+    for (const auto& [candidate, func] : com.functions) {
+        if (candidate.name != key.name || candidate.args.size() != key.args.size()) continue;
+        const auto convertible = std::ranges::all_of(zip(key.args, candidate.args), [](const auto& pair) {
+            const auto& [from, to] = pair;
+            return is_convertible(from, to);
+        });
+        if (convertible) {
+            if (found) return std::nullopt; // Ambiguous
+            found = candidate;
+        }
+    }
+    return found;
+}
+
+// vec<T>() is the only call that takes type args, and constructs an empty vec
+auto vec_constructor_type(const compiler& com, const node_function_call_expr& node) -> type_name
+{
+    compiler_assert(
+        node.templates.size() == 1 && node.args.empty(), node.token,
+        "vec must be constructed as vec<T>()"
+    );
+    const auto& inner = node.templates.front();
+    verify_real_type(com, node.token, inner);
+    compiler_assert(com.types.size_of(inner) > 0, node.token, "cannot make a vec of zero sized type '{}'", inner);
+    return concrete_vec_type(inner);
+}
+
+// The member functions of vec are implemented natively by the runtime rather than in the language
+auto vec_member_function_type(const token& tok, const type_name& type, const std::string& name) -> type_name
+{
+    if (name == "push" || name == "reserve" || name == "clear" || name == "append") return null_type();
+    if (name == "pop" || name == "at") return inner_type(type);
+    if (name == "size" || name == "capacity") return u64_type();
+    compiler_error(tok, "could not find function '{}::{}'", type, name);
+}
+
+// Vec member functions that do not modify the vec
+auto is_vec_reader(const std::string& name) -> bool
+{
+    return name == "size" || name == "capacity" || name == "at";
+}
+
+auto is_format_print_call(const node_function_call_expr& node) -> bool;
+
 auto type_of_expr(const compiler& com, const node_expr& node) -> type_name
 {
     return std::visit(overloaded{
@@ -424,20 +654,39 @@ auto type_of_expr(const compiler& com, const node_expr& node) -> type_name
             return r->result_type;
         },
         [&](const node_function_call_expr& expr) {
+            if (expr.function_name == tk_vec) {
+                return vec_constructor_type(com, expr);
+            }
+            if (const auto type = make_type(expr.function_name); com.types.contains(type)) {
+                return type; // Constructor call or conversion
+            }
             auto key = function_key{};
             key.name = expr.function_name;
             key.args.reserve(expr.args.size());
             for (const auto& arg : expr.args) {
                 key.args.push_back(type_of_expr(com, *arg));
             }
-            auto it = com.functions.find(key);
-            if (it == com.functions.end()) {
+            const auto found = find_function(com, key);
+            if (!found) {
+                // These are compiled specially rather than being builtins, see compile_expr_val
+                if (is_format_print_call(expr)) {
+                    return null_type();
+                }
+                if ((key.name == "read_file" || key.name == "embed") && key.args.size() == 1) {
+                    return file_view_type();
+                }
+                if (is_builtin(key.name, key.args)) {
+                    return fetch_builtin(key.name, key.args).return_type;
+                }
                 compiler_error(expr.token, "could not find function '{}({})'", key.name, format_comma_separated(key.args));
             }
-            return it->second.sig.return_type;
+            return com.functions.at(*found).sig.return_type;
         },
         [&](const node_member_function_call_expr& expr) {
             const auto obj_type = type_of_expr(com, *expr.expr);
+            if (is_vec_type(obj_type)) {
+                return vec_member_function_type(expr.token, obj_type, expr.function_name);
+            }
             auto key = function_key{};
             key.name = std::format("{}::{}", obj_type, expr.function_name);
             key.args.reserve(expr.args.size() + 1);
@@ -445,12 +694,12 @@ auto type_of_expr(const compiler& com, const node_expr& node) -> type_name
             for (const auto& arg : expr.args) {
                 key.args.push_back(type_of_expr(com, *arg));
             }
-            const auto it = com.functions.find(key);
-            if (it == com.functions.end()) {
+            const auto found = find_function(com, key);
+            if (!found) {
                 const auto function_str = std::format("{}({})", key.name, format_comma_separated(key.args));
                 compiler_error(expr.token, "could not find function '{}'", function_str);
             }
-            return it->second.sig.return_type;
+            return com.functions.at(*found).sig.return_type;
         },
         [&](const node_list_expr& expr) {
             return type_name{type_list{
@@ -489,13 +738,20 @@ auto type_of_expr(const compiler& com, const node_expr& node) -> type_name
         },
         [&](const node_subscript_expr& expr) {
             const auto ltype = type_of_expr(com, *expr.expr);
-            if (!std::holds_alternative<type_list>(ltype)) {
+            if (!is_list_type(ltype) && !is_slice_type(ltype) && !is_simd_type(ltype) && !is_vec_type(ltype)) {
                 compiler_error(expr.token, "cannot use subscript operator on non-list type '{}'", ltype);
             }
-            return *std::get<type_list>(ltype).inner_type;
+            return inner_type(ltype);
+        },
+        [&](const node_slice_expr& expr) {
+            const auto ltype = type_of_expr(com, *expr.expr);
+            if (!is_list_type(ltype) && !is_slice_type(ltype) && !is_vec_type(ltype)) {
+                compiler_error(expr.token, "cannot slice non-list type '{}'", ltype);
+            }
+            return concrete_slice_type(inner_type(ltype));
         },
         [&](const node_new_expr& expr) {
-            return concrete_ptr_type(expr.type);
+            return com.types.is_soa(expr.type) ? concrete_slice_type(expr.type) : concrete_ptr_type(expr.type);
         }
     }, node);
 }
@@ -504,48 +760,215 @@ auto compile_expr_ptr(compiler& com, const node_expr& node) -> type_name;
 auto compile_expr_val(compiler& com, const node_expr& expr) -> type_name;
 auto compile_stmt(compiler& com, const node_stmt& root) -> void;
 
-auto compile_expr_ptr(compiler& com, const node_variable_expr& node) -> type_name
+// Returns true if the variable is a local of the current function whose address may be taken
+// somewhere in the function, as found by the aliasing prescan.
+auto is_aliased_local(const compiler& com, const std::string& name) -> bool
 {
-    return push_var_addr(com, node.token, node.name);
+    if (!com.current_func) return false;
+    const auto var = com.current_func->vars.find(name);
+    const auto& aliased = com.current_func->aliased;
+    return var && (aliased.address_taken.contains(name)
+        || (!is_vec_type(var->type) && aliased.unless_vec.contains(name)));
 }
 
-auto compile_expr_ptr(compiler& com, const node_field_expr& node) -> type_name
+// Returns true if the variable is a local of the current function whose address is never taken,
+// so it can only be modified by name.
+auto is_unaliased_local(const compiler& com, const std::string& name) -> bool
 {
-    const auto type = compile_expr_ptr(com, *node.expr);
-    return compile_ptr_to_field(com, node.token, type, node.field_name);
+    return com.current_func && com.current_func->vars.find(name) && !is_aliased_local(com, name);
+}
+
+// Returns true if a local in scope may have its address taken, in which case a pointer into the
+// current frame may be passed to a called function.
+auto has_aliased_local(const compiler& com) -> bool
+{
+    if (!com.current_func) return false;
+    const auto& aliased = com.current_func->aliased;
+    const auto is_aliased = [&](const std::string& name) { return is_aliased_local(com, name); };
+    return std::ranges::any_of(aliased.address_taken, is_aliased)
+        || std::ranges::any_of(aliased.unless_vec, is_aliased);
+}
+
+// Compiles the argument that replaces a parameter of an inlined function. This happens in the
+// context of the call site, so the substitutions of the current inlined call do not apply.
+auto compile_inline_arg(compiler& com, const inline_arg& arg, bool as_ptr) -> type_name
+{
+    auto frame = std::move(com.inline_frames.back());
+    com.inline_frames.pop_back();
+    auto type = type_name{};
+    if (arg.is_addrof) {
+        type = concrete_ptr_type(compile_expr_ptr(com, *arg.expr));
+    } else {
+        type = as_ptr ? compile_expr_ptr(com, *arg.expr) : compile_expr_val(com, *arg.expr);
+    }
+    com.inline_frames.push_back(std::move(frame));
+    return type;
+}
+
+auto compile_expr_ptr(compiler& com, const node_variable_expr& node) -> type_name
+{
+    if (const auto arg = find_inline_arg(com, node.name); arg.has_value()) {
+        return compile_inline_arg(com, *arg, true);
+    }
+    return push_var_addr(com, node.token, node.name);
 }
 
 auto compile_expr_ptr(compiler& com, const node_deref_expr& node) -> type_name
 {
     const auto type = compile_expr_val(com, *node.expr); // Push the address
     compiler_assert(is_ptr_type(type), node.token, "cannot use deref operator on non-ptr type '{}'", type);
+    if (com.options.check_bounds) {
+        com.program.code.emplace_back(op_check_ptr{ .size=com.types.size_of(inner_type(type)) });
+    }
     return inner_type(type);
 }
 
+auto literal_u64(const node_expr& node) -> std::optional<std::uint64_t>
+{
+    const auto literal = std::get_if<node_literal_expr>(&node);
+    if (!literal || literal->value.type != u64_type()) return std::nullopt;
+    auto value = std::uint64_t{0};
+    std::memcpy(&value, literal->value.data.data(), sizeof(value));
+    return value;
+}
+
+// Returns true if the index is known to be less than the count, so a bounds check cannot fail.
+// Literal indices out of range are an error.
+auto is_index_in_range(const compiler& com, const node_expr& index, std::size_t count) -> bool
+{
+    if (const auto value = literal_u64(index)) {
+        if (*value >= count) {
+            const auto& tok = std::get<node_literal_expr>(index).token;
+            compiler_error(tok, "index {} out of range for list of size {}", *value, count);
+        }
+        return true;
+    }
+
+    const auto var = std::get_if<node_variable_expr>(&index);
+    if (!var || find_inline_arg(com, var->name)) return false;
+    return std::ranges::any_of(com.range_facts, [&](const range_fact& fact) {
+        return fact.name == var->name && fact.bound <= count;
+    });
+}
+
 auto compile_expr_ptr(compiler& com, const node_subscript_expr& expr) -> type_name
 {
-    const auto ltype = compile_expr_ptr(com, *expr.expr);
+    // The elements of a slice are stored elsewhere, so the slice itself need not be an lvalue
+    if (is_slice_type(type_of_expr(com, *expr.expr))) {
+        const auto etype = inner_type(compile_expr_val(com, *expr.expr));
+        compiler_assert(
+            !com.types.is_soa(etype), expr.token,
+            "elements of a slice of soa type '{}' can only be accessed through their fields", etype
+        );
+        const auto itype = compile_expr_val(com, *expr.index);
+        compiler_assert(itype == u64_type(), expr.token, "subscript argument must be a 'u64', got '{}'", itype);
+        com.program.code.emplace_back(op_slice_index_addr{
+            .elem_size = com.types.size_of(etype), .checked = com.options.check_bounds
+        });
+        return etype;
+    }
+
+    // The elements of a vec are on the heap, and the vec knows its own size to check against
+    if (is_vec_type(type_of_expr(com, *expr.expr))) {
+        const auto etype = inner_type(compile_expr_ptr(com, *expr.expr));
+        const auto itype = compile_expr_val(com, *expr.index);
+        compiler_assert(itype == u64_type(), expr.token, "subscript argument must be a 'u64', got '{}'", itype);
+        com.program.code.emplace_back(op_vec_index_addr{
+            .elem_size = com.types.size_of(etype), .checked = com.options.check_bounds
+        });
+        return etype;
+    }
+
+    auto ltype = compile_expr_ptr(com, *expr.expr);
+
+    // The lanes of a vector are laid out like the elements of a list, so are indexed the same way
+    if (is_simd_type(ltype)) {
+        ltype = concrete_list_type(inner_type(ltype), simd_lanes(ltype));
+    }
     if (!std::holds_alternative<type_list>(ltype)) {
         compiler_error(expr.token, "cannot use subscript operator on non-list type '{}'", ltype);
     }
-    const auto etype = *std::get<type_list>(ltype).inner_type;
-    const auto etype_size = com.types.size_of(etype);
+    const auto& list = std::get<type_list>(ltype);
+    const auto etype = *list.inner_type;
+    compiler_assert(
+        !com.types.is_soa(etype), expr.token,
+        "elements of a list of soa type '{}' can only be accessed through their fields", etype
+    );
 
-    // Push the offset (index * size)
     const auto itype = compile_expr_val(com, *expr.index);
     compiler_assert(itype == u64_type(), expr.token, "subscript argument must be a 'u64', got '{}'", itype);
 
-    push_literal(com, etype_size);
-    const auto info = resolve_binary_op(com.types, { .op="*", .lhs=itype, .rhs=itype });
-    com.program.emplace_back(op_builtin_call{
-        .name = "uint * uint",
-        .ptr = info->operator_func
+    com.program.code.emplace_back(op_index_addr{
+        .elem_size = com.types.size_of(etype),
+        .count = list.count,
+        .checked = com.options.check_bounds && !is_index_in_range(com, *expr.index, list.count)
     });
-
-    com.program.emplace_back(op_modify_ptr{});
     return etype;
 }
 
+// Lists of soa types store the values of each field in their own column, so the field of an
+// element is found at the start of its column plus the index times the size of the field. The
+// columns of a slice are as long as the slice, which is only known at runtime.
+auto compile_ptr_to_soa_field(
+    compiler& com, const node_field_expr& node, const node_subscript_expr& subscript
+)
+    -> type_name
+{
+    if (is_slice_type(type_of_expr(com, *subscript.expr))) {
+        const auto etype = inner_type(compile_expr_val(com, *subscript.expr));
+        const auto fields = com.types.fields_of(etype);
+        const auto offsets = com.types.offsets_of(etype);
+        for (const auto& [field, offset] : zip(fields, offsets)) {
+            if (field.name == node.field_name) {
+                const auto itype = compile_expr_val(com, *subscript.index);
+                compiler_assert(itype == u64_type(), subscript.token, "subscript argument must be a 'u64', got '{}'", itype);
+                com.program.code.emplace_back(op_soa_slice_field_addr{
+                    .field_offset = offset,
+                    .field_size = com.types.size_of(field.type),
+                    .checked = com.options.check_bounds
+                });
+                return field.type;
+            }
+        }
+        compiler_error(node.token, "could not find field '{}' for type '{}'\n", node.field_name, etype);
+    }
+
+    const auto ltype = compile_expr_ptr(com, *subscript.expr);
+    const auto& list = std::get<type_list>(ltype);
+
+    const auto fields = com.types.fields_of(*list.inner_type);
+    const auto offsets = com.types.offsets_of(*list.inner_type);
+    for (const auto& [field, offset] : zip(fields, offsets)) {
+        if (field.name == node.field_name) {
+            push_literal(com, offset * list.count);
+            com.program.code.emplace_back(op_modify_ptr{});
+
+            const auto itype = compile_expr_val(com, *subscript.index);
+            compiler_assert(itype == u64_type(), subscript.token, "subscript argument must be a 'u64', got '{}'", itype);
+            com.program.code.emplace_back(op_index_addr{
+                .elem_size = com.types.size_of(field.type),
+                .count = list.count,
+                .checked = com.options.check_bounds && !is_index_in_range(com, *subscript.index, list.count)
+            });
+            return field.type;
+        }
+    }
+
+    compiler_error(node.token, "could not find field '{}' for type '{}'\n", node.field_name, *list.inner_type);
+}
+
+auto compile_expr_ptr(compiler& com, const node_field_expr& node) -> type_name
+{
+    if (const auto subscript = std::get_if<node_subscript_expr>(node.expr.get())) {
+        const auto ltype = type_of_expr(com, *subscript->expr);
+        if ((is_list_type(ltype) || is_slice_type(ltype)) && com.types.is_soa(inner_type(ltype))) {
+            return compile_ptr_to_soa_field(com, node, *subscript);
+        }
+    }
+    const auto type = compile_expr_ptr(com, *node.expr);
+    return compile_ptr_to_field(com, node.token, type, node.field_name);
+}
+
 [[noreturn]] auto compile_expr_ptr(compiler& com, const auto& node) -> type_name
 {
     compiler_error(node.token, "cannot take address of a non-lvalue\n");
@@ -556,14 +979,61 @@ auto compile_expr_ptr(compiler& com, const node_expr& node) -> type_name
     return std::visit([&](const auto& expr) { return compile_expr_ptr(com, expr); }, node);
 }
 
+// Literals larger than this are stored in the read-only data segment rather than in the op
+// code that loads them.
+constexpr auto rom_literal_threshold = std::size_t{64};
+
+auto push_constant(compiler& com, const std::vector<std::byte>& data) -> void
+{
+    if (data.size() > rom_literal_threshold) {
+        const auto position = com.program.rom.size();
+        com.program.rom.insert(com.program.rom.end(), data.begin(), data.end());
+        com.program.code.emplace_back(op_load_rom{ .position=position, .size=data.size() });
+    } else {
+        com.program.code.emplace_back(op_load_bytes{data});
+    }
+}
+
 auto compile_expr_val(compiler& com, const node_literal_expr& node) -> type_name
 {
-    com.program.emplace_back(op_load_bytes{node.value.data});
+    push_constant(com, node.value.data);
     return node.value.type;
 }
 
+// Compiles '&&' and '||' such that the rhs is only evaluated if the lhs does not already
+// determine the result.
+auto compile_short_circuit_op(compiler& com, const node_binary_op_expr& node) -> type_name
+{
+    const auto is_and = node.token.text == tk_and;
+
+    const auto lhs = compile_expr_val(com, *node.lhs);
+    compiler_assert(lhs == bool_type(), node.token, "lhs of '{}' must be a bool, got '{}'", node.token.text, lhs);
+    const auto jump_pos = append_op(com, op_jump_if_false{});
+
+    if (is_and) {
+        const auto rhs = compile_expr_val(com, *node.rhs);
+        compiler_assert(rhs == bool_type(), node.token, "rhs of '{}' must be a bool, got '{}'", node.token.text, rhs);
+        const auto end_jump_pos = append_op(com, op_jump{});
+        std::get<op_jump_if_false>(com.program.code[jump_pos]).jump = com.program.code.size() - jump_pos;
+        push_literal(com, false);
+        std::get<op_jump>(com.program.code[end_jump_pos]).jump = com.program.code.size() - end_jump_pos;
+    } else {
+        push_literal(com, true);
+        const auto end_jump_pos = append_op(com, op_jump{});
+        std::get<op_jump_if_false>(com.program.code[jump_pos]).jump = com.program.code.size() - jump_pos;
+        const auto rhs = compile_expr_val(com, *node.rhs);
+        compiler_assert(rhs == bool_type(), node.token, "rhs of '{}' must be a bool, got '{}'", node.token.text, rhs);
+        std::get<op_jump>(com.program.code[end_jump_pos]).jump = com.program.code.size() - end_jump_pos;
+    }
+    return bool_type();
+}
+
 auto compile_expr_val(compiler& com, const node_binary_op_expr& node) -> type_name
 {
+    if (node.token.text == tk_and || node.token.text == tk_or) {
+        return compile_short_circuit_op(com, node);
+    }
+
     const auto lhs = compile_expr_val(com, *node.lhs);
     const auto rhs = compile_expr_val(com, *node.rhs);
     const auto op = node.token.text;
@@ -571,9 +1041,11 @@ auto compile_expr_val(compiler& com, const node_binary_op_expr& node) -> type_na
     const auto info = resolve_binary_op(com.types, { .op=op, .lhs=lhs, .rhs=rhs });
     compiler_assert(info.has_value(), node.token, "could not evaluate '{} {} {}'", lhs, op, rhs);
 
-    com.program.emplace_back(op_builtin_call{
+    com.program.code.emplace_back(op_builtin_call{
         .name = std::format("{} {} {}", lhs, op, rhs),
-        .ptr = info->operator_func
+        .ptr = info->operator_func,
+        .args_size = com.types.size_of(lhs) + com.types.size_of(rhs),
+        .return_size = com.types.size_of(info->result_type)
     });
     return info->result_type;
 }
@@ -585,98 +1057,546 @@ auto compile_expr_val(compiler& com, const node_unary_op_expr& node) -> type_nam
     const auto info = resolve_unary_op({.op = op, .type = type});
     compiler_assert(info.has_value(), node.token, "could not evaluate '{}{}'", op, type);
 
-    com.program.emplace_back(op_builtin_call{
+    com.program.code.emplace_back(op_builtin_call{
         .name = std::format("{}{}", op, type),
-        .ptr = info->operator_func
+        .ptr = info->operator_func,
+        .args_size = com.types.size_of(type),
+        .return_size = com.types.size_of(info->result_type)
     });
     return info->result_type;
 } 
 
-auto compile_expr_val(compiler& com, const node_function_call_expr& node) -> type_name
-{
-    // If this is the name of a simple type, then this is a constructor call, so
-    // there is currently nothing to do since the arguments are already pushed to
-    // the stack.
-    if (const auto type = make_type(node.function_name); com.types.contains(type)) {
-        const auto sig = make_constructor_sig(com, type);
-        std::vector<type_name> param_types;
-        for (const auto& arg : node.args) {
-            param_types.emplace_back(compile_expr_val(com, *arg));
+// Splits a format string into the pieces of text surrounding each '{}' placeholder. Braces
+// can be escaped by doubling them up.
+auto parse_format_string(const token& tok, std::string_view fmt) -> std::vector<std::string>
+{
+    auto pieces = std::vector<std::string>{""};
+    for (std::size_t i = 0; i != fmt.size(); ++i) {
+        if (fmt[i] == '{' && i + 1 != fmt.size() && fmt[i + 1] == '{') {
+            pieces.back() += '{';
+            ++i;
+        } else if (fmt[i] == '}' && i + 1 != fmt.size() && fmt[i + 1] == '}') {
+            pieces.back() += '}';
+            ++i;
+        } else if (fmt[i] == '{' && i + 1 != fmt.size() && fmt[i + 1] == '}') {
+            pieces.emplace_back();
+            ++i;
+        } else if (fmt[i] == '{' || fmt[i] == '}') {
+            compiler_error(tok, "invalid format string, unmatched '{}' at position {}", fmt[i], i);
+        } else {
+            pieces.back() += fmt[i];
         }
-        verify_sig(node.token, sig, param_types);
-        return type;
     }
+    return pieces;
+}
 
-    // Otherwise, it may be a custom function.
-    auto key = function_key{};
-    key.name = node.function_name;
-    key.args.reserve(node.args.size());
-    for (const auto& arg : node.args) {
-        key.args.push_back(type_of_expr(com, *arg));
+// Any call to print or println whose first arg is a string literal is formatted, even without
+// other args, so that escaped braces and stray placeholders are handled the same way.
+auto is_format_print_call(const node_function_call_expr& node) -> bool
+{
+    if ((node.function_name != "print" && node.function_name != "println") || node.args.empty()) {
+        return false;
     }
-    
-    if (auto it = com.functions.find(key); it != com.functions.end()) {
-        const auto& [sig, ptr, tok] = it->second;
-        push_literal(com, std::uint64_t{0}); // base ptr
-        push_literal(com, std::uint64_t{0}); // prog ptr
-        
-        // Push the args to the stack
-        std::vector<type_name> param_types;
-        for (const auto& arg : node.args) {
-            param_types.emplace_back(compile_expr_val(com, *arg));
-        }
-        verify_sig(node.token, sig, param_types);
-        com.program.emplace_back(op_function_call{
-            .name=node.function_name,
-            .ptr=ptr + 1, // Jump into the function
-            .args_size=signature_args_size(com, sig)
-        });
-        return sig.return_type;
+    const auto& fmt = *node.args.front();
+    return std::holds_alternative<node_literal_expr>(fmt)
+        && is_list_type(std::get<node_literal_expr>(fmt).value.type)
+        && inner_type(std::get<node_literal_expr>(fmt).value.type) == char_type();
+}
+
+// Compiles print("...", args...) and println("...", args...). The format string is parsed and
+// checked against the arg types here, so at runtime only the args are pushed to the stack and
+// a single builtin formats and prints the whole line.
+auto compile_format_print(compiler& com, const node_function_call_expr& node) -> type_name
+{
+    const auto& fmt_data = std::get<node_literal_expr>(*node.args.front()).value.data;
+    const auto fmt = std::string(reinterpret_cast<const char*>(fmt_data.data()), fmt_data.size());
+    const auto pieces = parse_format_string(node.token, fmt);
+
+    const auto num_args = node.args.size() - 1;
+    if (pieces.size() - 1 != num_args) {
+        compiler_error(
+            node.token, "format string has {} placeholders but {} args were given",
+            pieces.size() - 1, num_args
+        );
     }
 
-    // Otherwise, it must be a builtin function.
-    // Push the args to the stack
-    auto param_types = std::vector<type_name>{};
+    auto arg_types = std::vector<type_name>{};
+    auto arg_sizes = std::vector<std::size_t>{};
     auto args_size = std::size_t{0};
-    for (const auto& arg : node.args) {
-        param_types.emplace_back(compile_expr_val(com, *arg));
-        args_size += com.types.size_of(param_types.back());
+    for (const auto& arg : node.args | std::views::drop(1)) {
+        arg_types.emplace_back(compile_expr_val(com, *arg));
+        compiler_assert(is_formattable(arg_types.back()), node.token, "cannot format a value of type '{}'", arg_types.back());
+        arg_sizes.push_back(com.types.size_of(arg_types.back()));
+        args_size += arg_sizes.back();
     }
 
-    if (is_builtin(node.function_name, param_types)) {
-        const auto& builtin = fetch_builtin(node.function_name, param_types);
+    const auto builtin = make_format_builtin(pieces, arg_types, arg_sizes, node.function_name == "println");
+    com.program.code.emplace_back(op_builtin_call{
+        .name=std::format("{}(format)", node.function_name),
+        .ptr=builtin.ptr,
+        .args_size=args_size,
+        .return_size=com.types.size_of(builtin.return_type)
+    });
+    return builtin.return_type;
+}
 
-        com.program.emplace_back(op_builtin_call{
-            .name=node.function_name,
-            .ptr=builtin.ptr,
-            .args_size=args_size
-        });
-        return builtin.return_type;
-    }
+// Returns true if evaluating the expression has no side effects, so that it can be evaluated
+// any number of times, or not at all.
+auto is_pure_expr(const node_expr& node) -> bool
+{
+    return std::visit(overloaded{
+        [](const node_literal_expr&) { return true; },
+        [](const node_variable_expr&) { return true; },
+        [](const node_sizeof_expr&) { return true; },
+        [](const node_field_expr& expr) { return is_pure_expr(*expr.expr); },
+        [](const node_unary_op_expr& expr) { return is_pure_expr(*expr.expr); },
+        [](const node_binary_op_expr& expr) { return is_pure_expr(*expr.lhs) && is_pure_expr(*expr.rhs); },
+        [](const node_list_expr& expr) {
+            return std::ranges::all_of(expr.elements, [](const auto& e) { return is_pure_expr(*e); });
+        },
+        [](const node_repeat_list_expr& expr) { return is_pure_expr(*expr.value); },
+        [](const node_addrof_expr& expr) { return is_pure_expr(*expr.expr); },
+        [](const node_deref_expr& expr) { return is_pure_expr(*expr.expr); },
+        [](const node_subscript_expr& expr) { return is_pure_expr(*expr.expr) && is_pure_expr(*expr.index); },
+        [](const node_slice_expr& expr) {
+            return is_pure_expr(*expr.expr) && is_pure_expr(*expr.lower) && is_pure_expr(*expr.upper);
+        },
+        [](const auto&) { return false; }
+    }, node);
+}
 
-    const auto function_str = std::format("{}({})", node.function_name, format_comma_separated(key.args));
-    compiler_error(node.token, "could not find function '{}'", function_str);
+// Returns true if the expression is cheap enough to evaluate more than once.
+auto is_trivial_expr(const node_expr& node) -> bool
+{
+    return std::visit(overloaded{
+        [](const node_literal_expr&) { return true; },
+        [](const node_variable_expr&) { return true; },
+        [](const node_field_expr& expr) { return is_trivial_expr(*expr.expr); },
+        [](const node_addrof_expr& expr) { return is_trivial_expr(*expr.expr); },
+        [](const node_deref_expr& expr) { return is_trivial_expr(*expr.expr); },
+        [](const auto&) { return false; }
+    }, node);
 }
 
-auto compile_expr_val(compiler& com, const node_member_function_call_expr& node) -> type_name
+auto is_lvalue_expr(const node_expr& node) -> bool
 {
-    const auto obj_type = type_of_expr(com, *node.expr);
-    const auto qualified_function_name = std::format("{}::{}", obj_type, node.function_name);
+    return std::visit(overloaded{
+        [](const node_variable_expr&) { return true; },
+        [](const node_field_expr& expr) { return is_lvalue_expr(*expr.expr); },
+        [](const node_subscript_expr& expr) { return is_lvalue_expr(*expr.expr); },
+        [](const node_deref_expr&) { return true; },
+        [](const auto&) { return false; }
+    }, node);
+}
 
-    auto key = function_key{};
-    key.name = qualified_function_name;
-    key.args.reserve(node.args.size() + 1);
-    key.args.push_back(concrete_ptr_type(obj_type));
-    for (const auto& arg : node.args) {
-        key.args.push_back(type_of_expr(com, *arg));
+auto has_destructor(const compiler& com, const type_name& type) -> bool
+{
+    if (is_vec_type(type)) return true;
+    const auto key = function_key{
+        .name=std::format("{}::drop", type), .args={ concrete_ptr_type(type) }
+    };
+    return com.functions.contains(key);
+}
+
+// Attempts to compile the call to the given function by inlining its return expression. The
+// self expr is given for member functions, and is passed by address as the first parameter.
+// Returns false if the call cannot be inlined, in which case nothing is compiled.
+auto try_compile_inline(
+    compiler& com,
+    const function_key& key,
+    const node_expr* self,
+    const std::vector<node_expr_ptr>& args
+)
+    -> bool
+{
+    const auto it = com.inline_functions.find(key);
+    if (it == com.inline_functions.end()) {
+        return false;
+    }
+    const auto& [expr, params] = it->second;
+    const auto& sig = com.functions.at(key).sig;
+
+    auto frame = inline_frame{};
+    for (std::size_t i = 0; i != sig.params.size(); ++i) {
+        const auto& [name, type] = sig.params[i];
+        const auto is_self = self && i == 0;
+        const auto& arg = is_self ? *self : *args[self ? i - 1 : i];
+
+        // Parameters are copies that get destructed at the end of a call
+        if (has_destructor(com, type)) return false;
+
+        // Args converted to slices cannot be substituted for the parameter
+        if (!is_self && type_of_expr(com, arg) != type) return false;
+
+        if (!is_pure_expr(arg)) return false;
+        if (params[i].uses > 1 && !is_trivial_expr(arg)) return false;
+        if ((is_self || params[i].needs_lvalue) && !is_lvalue_expr(arg)) return false;
+        if (is_self && params[i].needs_lvalue) return false;
+
+        frame.emplace(name, inline_arg{ .expr=&arg, .is_addrof=is_self, .type=type });
+    }
+
+    com.inline_frames.push_back(std::move(frame));
+    compile_expr_val(com, *expr);
+    com.inline_frames.pop_back();
+    return true;
+}
+
+// Calls to pure functions with literal args are evaluated at compile time by running the call
+// on a scratch runtime, and the call is replaced with the result. The evaluation gives up after
+// this many ops, in which case the call is made at runtime as normal.
+constexpr auto evaluation_step_budget = std::size_t{1'000'000};
+
+auto try_evaluate_call(
+    compiler& com, const node_function_call_expr& node, const function_val& func
+)
+    -> bool
+{
+    if (!com.options.evaluate_pure_calls || !com.pure_functions.contains(func.ptr)) {
+        return false;
+    }
+    const auto is_literal = [](const auto& arg) { return std::holds_alternative<node_literal_expr>(*arg); };
+    if (!std::ranges::all_of(node.args, is_literal)) {
+        return false;
+    }
+
+    // Append the call to the end of the program, run it and then remove it again
+    const auto stub_pos = com.program.code.size();
+    push_literal(com, std::uint64_t{0}); // base ptr
+    push_literal(com, std::uint64_t{0}); // prog ptr
+    auto offset = 2 * sizeof(std::uint64_t);
+    for (const auto& arg : node.args) {
+        const auto& value = std::get<node_literal_expr>(*arg).value;
+        offset = align_next_arg(com, offset, value.type) + value.data.size();
+        com.program.code.emplace_back(op_load_bytes{value.data});
+    }
+    com.program.code.emplace_back(op_function_call{
+        .name=node.function_name,
+        .ptr=func.ptr + 1, // Jump into the function
+        .args_size=signature_args_size(com, func.sig),
+        .return_size=com.types.size_of(func.sig.return_type)
+    });
+    const auto result = evaluate(com.program, stub_pos, evaluation_step_budget);
+    com.program.code.erase(com.program.code.begin() + stub_pos, com.program.code.end());
+
+    if (!result) {
+        return false;
+    }
+    compiler_assert(result->size() == com.types.size_of(func.sig.return_type), node.token, "bad result size when evaluating '{}'", node.function_name);
+    push_constant(com, *result);
+    return true;
+}
+
+// Pushes a slice of all the elements of the given list, vec or slice. Lists and vecs must be
+// lvalues since the slice points into them.
+auto compile_slice_of(compiler& com, const token& tok, const node_expr& node) -> type_name
+{
+    const auto type = type_of_expr(com, node);
+    if (is_slice_type(type)) {
+        return compile_expr_val(com, node);
+    }
+    if (is_vec_type(type)) {
+        compiler_assert(is_lvalue_expr(node), tok, "cannot slice a temporary '{}'", type);
+        compiler_assert(!com.types.is_soa(inner_type(type)), tok, "cannot slice a vec of soa type '{}'", inner_type(type));
+        compile_expr_ptr(com, node);
+        com.program.code.emplace_back(op_load{ .size = 2 * sizeof(std::uint64_t) }); // data and size
+        return concrete_slice_type(inner_type(type));
+    }
+    compiler_assert(is_list_type(type), tok, "cannot slice non-list type '{}'", type);
+    compiler_assert(is_lvalue_expr(node), tok, "cannot slice a temporary '{}'", type);
+    compile_expr_ptr(com, node);
+    push_literal(com, std::get<type_list>(type).count);
+    return concrete_slice_type(inner_type(type));
+}
+
+// Pushes the args of a call, converting lists to slices where the function takes a slice
+auto compile_args(
+    compiler& com,
+    const token& tok,
+    const signature& sig,
+    const std::vector<node_expr_ptr>& args,
+    std::size_t first // The param that the first arg is for
+)
+    -> std::vector<type_name>
+{
+    auto offset = 2 * sizeof(std::uint64_t);
+    for (std::size_t i = 0; i != first && i != sig.params.size(); ++i) {
+        offset = align_up(offset, slot_alignment(com, sig.params[i].type)) + com.types.size_of(sig.params[i].type);
+    }
+
+    auto param_types = std::vector<type_name>{};
+    for (std::size_t i = 0; i != args.size(); ++i) {
+        const auto& arg = *args[i];
+        const auto expected = first + i < sig.params.size() ? sig.params[first + i].type : type_of_expr(com, arg);
+        offset = align_next_arg(com, offset, expected);
+        const auto is_conversion = first + i < sig.params.size()
+            && is_slice_type(sig.params[first + i].type)
+            && (is_list_type(type_of_expr(com, arg)) || is_vec_type(type_of_expr(com, arg)));
+        param_types.emplace_back(is_conversion ? compile_slice_of(com, tok, arg) : compile_expr_val(com, arg));
+        offset += com.types.size_of(param_types.back());
+    }
+    return param_types;
+}
+
+// Vectors are constructed either from a value for each lane, or from a single value which is
+// copied into every lane.
+auto compile_simd_constructor(
+    compiler& com, const node_function_call_expr& node, const type_name& type
+) -> type_name
+{
+    const auto lanes = simd_lanes(type);
+    const auto lane_type = inner_type(type);
+    compiler_assert(
+        node.args.size() == 1 || node.args.size() == lanes, node.token,
+        "'{}' must be constructed from 1 or {} values, got {}", type, lanes, node.args.size()
+    );
+    for (const auto& arg : node.args) {
+        const auto arg_type = compile_expr_val(com, *arg);
+        compiler_assert(
+            arg_type == lane_type, node.token,
+            "lanes of '{}' must be '{}', got '{}'", type, lane_type, arg_type
+        );
+    }
+    if (node.args.size() == 1) {
+        com.program.code.emplace_back(op_repeat{
+            .size=com.types.size_of(lane_type), .count=lanes
+        });
+    }
+    return type;
+}
+
+auto compile_expr_val(compiler& com, const node_function_call_expr& node) -> type_name
+{
+    // If this is the name of a simple type, then this is a constructor call, so
+    // there is currently nothing to do since the arguments are already pushed to
+    // the stack.
+    if (node.function_name == tk_vec) {
+        const auto type = vec_constructor_type(com, node);
+        push_padding(com, com.types.size_of(type)); // An empty vec is all zeroes
+        return type;
+    }
+    if (const auto type = make_type(node.function_name); com.types.contains(type)) {
+        if (is_simd_type(type)) {
+            return compile_simd_constructor(com, node, type);
+        }
+        const auto sig = make_constructor_sig(com, type);
+        const auto offsets = com.types.offsets_of(type);
+        std::vector<type_name> param_types;
+        auto size = std::size_t{0};
+        for (const auto& arg : node.args) {
+            if (param_types.size() < offsets.size() && size < offsets[param_types.size()]) {
+                push_padding(com, offsets[param_types.size()] - size);
+                size = offsets[param_types.size()];
+            }
+            param_types.emplace_back(compile_expr_val(com, *arg));
+            size += com.types.size_of(param_types.back());
+        }
+        if (!offsets.empty() && size < com.types.size_of(type)) {
+            push_padding(com, com.types.size_of(type) - size);
+        }
+
+        // Numeric types constructed from a number are conversions, which are builtins
+        if (is_builtin(node.function_name, param_types)) {
+            const auto& builtin = fetch_builtin(node.function_name, param_types);
+            com.program.code.emplace_back(op_builtin_call{
+                .name=node.function_name,
+                .ptr=builtin.ptr,
+                .args_size=com.types.size_of(param_types.front()),
+                .return_size=com.types.size_of(builtin.return_type)
+            });
+            return builtin.return_type;
+        }
+        verify_sig(node.token, sig, param_types);
+        return type;
+    }
+
+    // Otherwise, it may be a custom function.
+    auto key = function_key{};
+    key.name = node.function_name;
+    key.args.reserve(node.args.size());
+    for (const auto& arg : node.args) {
+        key.args.push_back(type_of_expr(com, *arg));
+    }
+    
+    if (const auto found = find_function(com, key); found) {
+        const auto& func = com.functions.at(*found);
+        const auto& [sig, ptr, tok] = func;
+        if (try_evaluate_call(com, node, func)) {
+            return sig.return_type;
+        }
+        if (try_compile_inline(com, *found, nullptr, node.args)) {
+            return sig.return_type;
+        }
+
+        push_literal(com, std::uint64_t{0}); // base ptr
+        push_literal(com, std::uint64_t{0}); // prog ptr
+        
+        // Push the args to the stack
+        const auto param_types = compile_args(com, node.token, sig, node.args, 0);
+        verify_sig(node.token, sig, param_types);
+        com.program.code.emplace_back(op_function_call{
+            .name=node.function_name,
+            .ptr=ptr + 1, // Jump into the function
+            .args_size=signature_args_size(com, sig),
+            .return_size=com.types.size_of(sig.return_type)
+        });
+        return sig.return_type;
+    }
+
+    // Otherwise, it may be a formatted print, which takes a string literal as its first arg.
+    if (is_format_print_call(node)) {
+        return compile_format_print(com, node);
+    }
+
+    // Otherwise, it may be read_file, which maps the given file into memory.
+    if (node.function_name == "read_file" && node.args.size() == 1) {
+        const auto path_type = compile_expr_val(com, *node.args.front());
+        if (!is_list_type(path_type) || inner_type(path_type) != char_type()) {
+            compiler_error(node.token, "read_file expects a string path, got '{}'", path_type);
+        }
+        com.program.code.emplace_back(op_map_file{
+            .path_size=com.types.size_of(path_type), .source_dir=com.options.source_dir.string()
+        });
+        return file_view_type();
+    }
+
+    // Otherwise, it may be embed, which reads the given file at compile time into the read-only
+    // data segment. This evaluates to a pointer into the segment, so nothing is copied at runtime.
+    if (node.function_name == "embed" && node.args.size() == 1) {
+        const auto& arg = *node.args.front();
+        const auto is_path_literal = std::holds_alternative<node_literal_expr>(arg)
+            && is_list_type(std::get<node_literal_expr>(arg).value.type)
+            && inner_type(std::get<node_literal_expr>(arg).value.type) == char_type();
+        compiler_assert(is_path_literal, node.token, "embed expects a string literal path");
+
+        const auto& path_data = std::get<node_literal_expr>(arg).value.data;
+        const auto path = std::string(reinterpret_cast<const char*>(path_data.data()), path_data.size());
+        auto file = std::ifstream{com.options.source_dir / path, std::ios::binary};
+        compiler_assert(file.good(), node.token, "could not embed file '{}'", path);
+        const auto contents = std::string{std::istreambuf_iterator<char>{file}, {}};
+
+        const auto position = com.program.rom.size();
+        for (const char c : contents) {
+            com.program.rom.push_back(static_cast<std::byte>(c));
+        }
+        com.program.code.emplace_back(op_push_rom_addr{ .position=position });
+        push_literal(com, contents.size());
+        return file_view_type();
+    }
+
+    // Otherwise, it must be a builtin function.
+    // Push the args to the stack
+    auto param_types = std::vector<type_name>{};
+    auto args_size = std::size_t{0};
+    for (const auto& arg : node.args) {
+        param_types.emplace_back(compile_expr_val(com, *arg));
+        args_size += com.types.size_of(param_types.back());
+    }
+
+    if (is_builtin(node.function_name, param_types)) {
+        const auto& builtin = fetch_builtin(node.function_name, param_types);
+
+        com.program.code.emplace_back(op_builtin_call{
+            .name=node.function_name,
+            .ptr=builtin.ptr,
+            .args_size=args_size,
+            .return_size=com.types.size_of(builtin.return_type)
+        });
+        return builtin.return_type;
+    }
+
+    const auto function_str = std::format("{}({})", node.function_name, format_comma_separated(key.args));
+    compiler_error(node.token, "could not find function '{}'", function_str);
+}
+
+// Each member function of vec is a single op that takes a pointer to the vec as its first arg
+auto compile_vec_member_call(
+    compiler& com, const node_member_function_call_expr& node, const type_name& type
+)
+    -> type_name
+{
+    const auto elem = inner_type(type);
+    const auto elem_size = com.types.size_of(elem);
+    const auto return_type = vec_member_function_type(node.token, type, node.function_name);
+
+    const auto expected_args = (node.function_name == "push" || node.function_name == "at"
+        || node.function_name == "reserve" || node.function_name == "append") ? 1 : 0;
+    compiler_assert(
+        node.args.size() == expected_args, node.token,
+        "'{}::{}' expects {} args, got {}", type, node.function_name, expected_args, node.args.size()
+    );
+    compiler_assert(is_lvalue_expr(*node.expr), node.token, "cannot call '{}' on a temporary '{}'", node.function_name, type);
+
+    if (node.function_name == "size" || node.function_name == "capacity") {
+        compile_expr_ptr(com, *node.expr);
+        compile_ptr_to_field(com, node.token, type, node.function_name);
+        com.program.code.emplace_back(op_load{ .size = sizeof(std::uint64_t) });
+    }
+    else if (node.function_name == "clear") {
+        push_literal(com, std::uint64_t{0});
+        compile_expr_ptr(com, *node.expr);
+        compile_ptr_to_field(com, node.token, type, "size");
+        com.program.code.emplace_back(op_save{ .size = sizeof(std::uint64_t) });
+        push_padding(com, com.types.size_of(null_type()));
+    }
+    else if (node.function_name == "pop") {
+        compile_expr_ptr(com, *node.expr);
+        com.program.code.emplace_back(op_vec_pop{ .elem_size = elem_size });
+    }
+    else if (node.function_name == "at") {
+        compile_expr_ptr(com, *node.expr);
+        const auto itype = compile_expr_val(com, *node.args[0]);
+        compiler_assert(itype == u64_type(), node.token, "'at' argument must be a 'u64', got '{}'", itype);
+        com.program.code.emplace_back(op_vec_index_addr{ .elem_size = elem_size, .checked = true });
+        com.program.code.emplace_back(op_load{ .size = elem_size });
+    }
+    else if (node.function_name == "push") {
+        compile_expr_ptr(com, *node.expr);
+        const auto vtype = compile_expr_val(com, *node.args[0]);
+        compiler_assert(vtype == elem, node.token, "cannot push '{}' to '{}'", vtype, type);
+        com.program.code.emplace_back(op_vec_push{ .elem_size = elem_size });
+    }
+    else if (node.function_name == "reserve") {
+        compile_expr_ptr(com, *node.expr);
+        const auto ntype = compile_expr_val(com, *node.args[0]);
+        compiler_assert(ntype == u64_type(), node.token, "'reserve' argument must be a 'u64', got '{}'", ntype);
+        com.program.code.emplace_back(op_vec_reserve{ .elem_size = elem_size });
+    }
+    else if (node.function_name == "append") {
+        compile_expr_ptr(com, *node.expr);
+        const auto stype = compile_slice_of(com, node.token, *node.args[0]);
+        compiler_assert(inner_type(stype) == elem, node.token, "cannot append '{}' to '{}'", stype, type);
+        com.program.code.emplace_back(op_vec_append{ .elem_size = elem_size });
+    }
+    return return_type;
+}
+
+auto compile_expr_val(compiler& com, const node_member_function_call_expr& node) -> type_name
+{
+    const auto obj_type = type_of_expr(com, *node.expr);
+    if (is_vec_type(obj_type)) {
+        return compile_vec_member_call(com, node, obj_type);
+    }
+    const auto qualified_function_name = std::format("{}::{}", obj_type, node.function_name);
+
+    auto key = function_key{};
+    key.name = qualified_function_name;
+    key.args.reserve(node.args.size() + 1);
+    key.args.push_back(concrete_ptr_type(obj_type));
+    for (const auto& arg : node.args) {
+        key.args.push_back(type_of_expr(com, *arg));
     }
     
-    const auto it = com.functions.find(key);
-    if (it == com.functions.end()) {
+    const auto found = find_function(com, key);
+    if (!found) {
         compiler_error(node.token, "could not find function '{}'", qualified_function_name);
     }
     
-    const auto& [sig, ptr, tok] = it->second;
+    const auto& [sig, ptr, tok] = com.functions.at(*found);
+    if (try_compile_inline(com, *found, node.expr.get(), node.args)) {
+        return sig.return_type;
+    }
+
     push_literal(com, std::uint64_t{0}); // base ptr
     push_literal(com, std::uint64_t{0}); // prog ptr
     
@@ -684,18 +1604,34 @@ auto compile_expr_val(compiler& com, const node_member_function_call_expr& node)
     std::vector<type_name> param_types;
     compile_expr_ptr(com, *node.expr);
     param_types.emplace_back(concrete_ptr_type(obj_type));
-    for (const auto& arg : node.args) {
-        param_types.emplace_back(compile_expr_val(com, *arg));
-    }
+    std::ranges::copy(compile_args(com, node.token, sig, node.args, 1), std::back_inserter(param_types));
     verify_sig(node.token, sig, param_types);
-    com.program.emplace_back(op_function_call{
+    com.program.code.emplace_back(op_function_call{
         .name=node.function_name,
         .ptr=ptr + 1, // Jump into the function
-        .args_size=signature_args_size(com, sig)
+        .args_size=signature_args_size(com, sig),
+        .return_size=com.types.size_of(sig.return_type)
     });
     return sig.return_type;
 }
 
+// Elements are pushed one after another, so lists of soa types must then be rearranged into
+// their column-wise layout.
+auto push_soa_pack(compiler& com, const type_name& type, std::size_t count) -> void
+{
+    if (!com.types.is_soa(type) || count < 2) return;
+    auto field_sizes = std::vector<std::size_t>{};
+    for (const auto& field : com.types.fields_of(type)) {
+        field_sizes.push_back(com.types.size_of(field.type));
+    }
+    com.program.code.emplace_back(op_soa_pack{
+        .object_size=com.types.size_of(type),
+        .count=count,
+        .field_offsets=com.types.offsets_of(type),
+        .field_sizes=field_sizes
+    });
+}
+
 auto compile_expr_val(compiler& com, const node_list_expr& node) -> type_name
 {
     compiler_assert(!node.elements.empty(), node.token, "currently do not support empty list literals");
@@ -705,6 +1641,7 @@ auto compile_expr_val(compiler& com, const node_list_expr& node) -> type_name
         const auto element_type = compile_expr_val(com, *element);
         compiler_assert(element_type == inner_type, node.token, "list has mismatching element types");
     }
+    push_soa_pack(com, inner_type, node.elements.size());
     return concrete_list_type(inner_type, node.elements.size());
 }
 
@@ -712,10 +1649,14 @@ auto compile_expr_val(compiler& com, const node_repeat_list_expr& node) -> type_
 {
     compiler_assert(node.size != 0, node.token, "currently do not support empty list literals");
 
-    const auto inner_type = type_of_expr(com, *node.value);
-    for (std::size_t i = 0; i != node.size; ++i) {
-        compile_expr_val(com, *node.value);
+    // The value is evaluated once and then copied into the remaining elements
+    const auto inner_type = compile_expr_val(com, *node.value);
+    if (node.size > 1) {
+        com.program.code.emplace_back(op_repeat{
+            .size=com.types.size_of(inner_type), .count=node.size
+        });
     }
+    push_soa_pack(com, inner_type, node.size);
     return concrete_list_type(inner_type, node.size);
 }
 
@@ -737,8 +1678,52 @@ auto compile_expr_val(compiler& com, const node_new_expr& node) -> type_name
 {
     const auto count = compile_expr_val(com, *node.size);
     compiler_assert(count == u64_type(), node.token, "count of array must be u64, got {}\n", count);
-    com.program.emplace_back(op_allocate{ .type_size=com.types.size_of(node.type) });
-    return concrete_ptr_type(node.type);
+
+    // The columns of soa types depend on the count, so the array is a slice that carries it
+    const auto is_soa = com.types.is_soa(node.type);
+    com.program.code.emplace_back(op_allocate{
+        .type_size=com.types.size_of(node.type),
+        .alignment=com.options.aligned_layout ? sizeof(std::uint64_t) : 1,
+        .as_slice=is_soa
+    });
+    return is_soa ? concrete_slice_type(node.type) : concrete_ptr_type(node.type);
+}
+
+auto compile_expr_val(compiler& com, const node_slice_expr& node) -> type_name
+{
+    const auto type = compile_slice_of(com, node.token, *node.expr);
+    compiler_assert(
+        !com.types.is_soa(inner_type(type)), node.token,
+        "cannot take part of a slice of soa type '{}', its columns would not line up", inner_type(type)
+    );
+    for (const auto& bound : {&node.lower, &node.upper}) {
+        const auto btype = compile_expr_val(com, **bound);
+        compiler_assert(btype == u64_type(), node.token, "slice bounds must be 'u64', got '{}'", btype);
+    }
+    com.program.code.emplace_back(op_subslice{
+        .elem_size = com.types.size_of(inner_type(type)), .checked = com.options.check_bounds
+    });
+    return type;
+}
+
+// Vecs own their elements, so copying one out of an lvalue also copies the elements. Otherwise
+// both copies would free the same block when dropped.
+auto copy_owned_memory(compiler& com, const type_name& type) -> void
+{
+    if (is_vec_type(type)) {
+        com.program.code.emplace_back(op_vec_copy{ .elem_size=com.types.size_of(inner_type(type)) });
+    }
+}
+
+auto compile_expr_val(compiler& com, const node_variable_expr& node) -> type_name
+{
+    if (const auto arg = find_inline_arg(com, node.name); arg.has_value()) {
+        return compile_inline_arg(com, *arg, false);
+    }
+    const auto type = push_var_addr(com, node.token, node.name);
+    com.program.code.emplace_back(op_load{ .size=com.types.size_of(type) });
+    copy_owned_memory(com, type);
+    return type;
 }
 
 // If not implemented explicitly, assume that the given node_expr is an lvalue, in which case
@@ -747,53 +1732,666 @@ auto compile_expr_val(compiler& com, const auto& node) -> type_name
 {
     const auto type = compile_expr_ptr(com, node);
     const auto size = com.types.size_of(type);
-    com.program.emplace_back(op_load{ .size=size });
+    com.program.code.emplace_back(op_load{ .size=size });
+    copy_owned_memory(com, type);
     return type;
 }
 
+auto mentions_name(const node_expr& node, const std::string& name) -> bool
+{
+    const auto mentions = [&](const node_expr_ptr& expr) { return mentions_name(*expr, name); };
+    return std::visit(overloaded{
+        [&](const node_variable_expr& expr) { return expr.name == name; },
+        [&](const node_field_expr& expr) { return mentions(expr.expr); },
+        [&](const node_unary_op_expr& expr) { return mentions(expr.expr); },
+        [&](const node_binary_op_expr& expr) { return mentions(expr.lhs) || mentions(expr.rhs); },
+        [&](const node_function_call_expr& expr) { return std::ranges::any_of(expr.args, mentions); },
+        [&](const node_member_function_call_expr& expr) {
+            return mentions(expr.expr) || std::ranges::any_of(expr.args, mentions);
+        },
+        [&](const node_list_expr& expr) { return std::ranges::any_of(expr.elements, mentions); },
+        [&](const node_repeat_list_expr& expr) { return mentions(expr.value); },
+        [&](const node_addrof_expr& expr) { return mentions(expr.expr); },
+        [&](const node_sizeof_expr& expr) { return mentions(expr.expr); },
+        [&](const node_deref_expr& expr) { return mentions(expr.expr); },
+        [&](const node_subscript_expr& expr) { return mentions(expr.expr) || mentions(expr.index); },
+        [&](const node_slice_expr& expr) {
+            return mentions(expr.expr) || mentions(expr.lower) || mentions(expr.upper);
+        },
+        [&](const node_new_expr& expr) { return mentions(expr.size); },
+        [](const node_literal_expr&) { return false; }
+    }, node);
+}
+
+auto mentions_name(const node_stmt& node, const std::string& name) -> bool
+{
+    const auto expr = [&](const node_expr_ptr& e) { return mentions_name(*e, name); };
+    const auto stmt = [&](const node_stmt_ptr& s) { return s && mentions_name(*s, name); };
+    return std::visit(overloaded{
+        [&](const node_sequence_stmt& node) { return std::ranges::any_of(node.sequence, stmt); },
+        [&](const node_while_stmt& node) { return expr(node.condition) || stmt(node.body); },
+        [&](const node_if_stmt& node) {
+            return expr(node.condition) || stmt(node.body) || stmt(node.else_body);
+        },
+        [&](const node_declaration_stmt& node) { return node.name == name || expr(node.expr); },
+        [&](const node_assignment_stmt& node) { return expr(node.position) || expr(node.expr); },
+        [&](const node_expression_stmt& node) { return expr(node.expr); },
+        [&](const node_return_stmt& node) { return expr(node.return_value); },
+        [&](const node_delete_stmt& node) { return expr(node.expr); },
+        [](const auto&) { return false; }
+    }, node);
+}
+
+// Finds a variable in the current scope whose slot can be given to the new variable declared by
+// the next statement, because it is never mentioned again. Variables whose address may have been
+// taken are excluded since pointers to them may still be used, as are types with destructors.
+auto find_reusable_slot(
+    const compiler& com, const node_declaration_stmt& decl, std::span<const node_stmt_ptr> rest
+)
+    -> std::optional<std::string>
+{
+    if (!com.current_func) return std::nullopt;
+
+    auto best = std::optional<std::pair<std::string, std::size_t>>{};
+    for (const auto& [name, info] : com.current_func->vars.current_scope().vars) {
+        if (name.starts_with('#') || has_destructor(com, info.type) || is_aliased_local(com, name)) continue;
+        if (best && best->second < info.location) continue;
+        if (name == decl.name || std::ranges::any_of(rest, [&](const auto& s) { return mentions_name(*s, name); })) {
+            continue;
+        }
+        best.emplace(name, info.location);
+    }
+    return best ? std::optional{best->first} : std::nullopt;
+}
+
 void compile_stmt(compiler& com, const node_sequence_stmt& node)
 {
     current_vars(com).push_scope(var_scope::scope_type::seq_stmt);
-    for (const auto& seq_node : node.sequence) {
-        compile_stmt(com, *seq_node);
+    for (std::size_t i = 0; i != node.sequence.size(); ++i) {
+        const auto& stmt = *node.sequence[i];
+        const auto decl = std::get_if<node_declaration_stmt>(&stmt);
+        if (decl && com.options.reuse_stack_slots) {
+            com.reusable_slot = find_reusable_slot(com, *decl, std::span{node.sequence}.subspan(i + 1));
+        }
+        compile_stmt(com, stmt);
     }
 
     destruct_on_end_of_scope(com);
     const auto scope_size = current_vars(com).pop_scope();
     if (scope_size > 0) {
-        com.program.emplace_back(op_pop{scope_size});
+        com.program.code.emplace_back(op_pop{scope_size});
+    }
+}
+
+// The variables that a loop may modify, and whether it may write to memory through pointers or
+// by calling functions, in which case any value loaded from memory may change between iterations.
+// Writes to variables that may be pointed to also change the values loaded through pointers.
+struct loop_effects
+{
+    std::unordered_set<std::string> written;
+    bool                            writes_memory = false;
+    bool                            writes_addressable = false;
+};
+
+// The type of a chain of fields and subscripts of a variable, or null if it is not known. This
+// is the case for variables declared in the loop being analysed, which are not compiled yet.
+auto type_if_declared(const compiler& com, const node_expr& node) -> std::optional<type_name>
+{
+    auto curr = &node;
+    while (true) {
+        if (const auto field = std::get_if<node_field_expr>(curr)) {
+            curr = field->expr.get();
+        } else if (const auto subscript = std::get_if<node_subscript_expr>(curr)) {
+            curr = subscript->expr.get();
+        } else {
+            break;
+        }
+    }
+    const auto var = std::get_if<node_variable_expr>(curr);
+    const auto is_declared = var && (find_inline_arg(com, var->name)
+        || (com.current_func && com.current_func->vars.find(var->name))
+        || com.globals.find(var->name));
+    if (!is_declared) return std::nullopt;
+    return type_of_expr(com, node);
+}
+
+// Returns true if the expression may be a slice or vec, whose elements are stored elsewhere
+auto may_store_elements_elsewhere(const compiler& com, const node_expr& node) -> bool
+{
+    const auto type = type_if_declared(com, node);
+    return !type || is_slice_type(*type) || is_vec_type(*type);
+}
+
+// The variable at the root of a chain of fields and subscripts, or null if it goes through a
+// pointer. Unlike root_variable, this does not need the types of the variables to be known.
+auto lvalue_root(const node_expr& node) -> const node_variable_expr*
+{
+    auto curr = &node;
+    while (true) {
+        if (const auto field = std::get_if<node_field_expr>(curr)) {
+            curr = field->expr.get();
+        } else if (const auto subscript = std::get_if<node_subscript_expr>(curr)) {
+            curr = subscript->expr.get();
+        } else {
+            break;
+        }
     }
+    return std::get_if<node_variable_expr>(curr);
 }
 
+// The variable at the root of a chain of fields and subscripts, or null if it goes through a
+// pointer or a slice.
+auto root_variable(const compiler& com, const node_expr& node) -> const node_variable_expr*
+{
+    auto curr = &node;
+    while (true) {
+        if (const auto field = std::get_if<node_field_expr>(curr)) {
+            curr = field->expr.get();
+        } else if (const auto subscript = std::get_if<node_subscript_expr>(curr)) {
+            if (may_store_elements_elsewhere(com, *subscript->expr)) return nullptr;
+            curr = subscript->expr.get();
+        } else {
+            break;
+        }
+    }
+    return std::get_if<node_variable_expr>(curr);
+}
+
+// Returns true if some function with the given name takes a slice as the given param, so a list
+// passed to it may be converted to a slice
+auto may_take_slice(const compiler& com, const std::string& name, std::size_t param) -> bool
+{
+    return std::ranges::any_of(com.functions, [&](const auto& entry) {
+        const auto& [key, func] = entry;
+        return key.name == name && param < key.args.size() && is_slice_type(key.args[param]);
+    });
+}
+
+// Finds the variables whose address is taken by '&', by slicing, by being converted to a slice
+// or by calling a member function, which is passed a pointer to the object. A pointer taken
+// later in the source may still be used earlier in a loop, so this is done for the whole
+// function body before it is compiled.
+auto find_aliased_vars(const compiler& com, const node_expr& node, aliased_vars& aliased) -> void
+{
+    const auto recurse = [&](const node_expr_ptr& expr) { find_aliased_vars(com, *expr, aliased); };
+    const auto address_taken = [&](const node_expr& expr) {
+        if (const auto var = lvalue_root(expr)) {
+            aliased.unless_vec.insert(var->name);
+        }
+    };
+
+    std::visit(overloaded{
+        [&](const node_unary_op_expr& expr) { recurse(expr.expr); },
+        [&](const node_binary_op_expr& expr) { recurse(expr.lhs); recurse(expr.rhs); },
+        [&](const node_function_call_expr& expr) {
+            for (std::size_t i = 0; i != expr.args.size(); ++i) {
+                if (may_take_slice(com, expr.function_name, i)) {
+                    address_taken(*expr.args[i]);
+                }
+            }
+            std::ranges::for_each(expr.args, recurse);
+        },
+        [&](const node_member_function_call_expr& expr) {
+            address_taken(*expr.expr);
+            recurse(expr.expr);
+            std::ranges::for_each(expr.args, recurse);
+        },
+        [&](const node_list_expr& expr) { std::ranges::for_each(expr.elements, recurse); },
+        [&](const node_repeat_list_expr& expr) { recurse(expr.value); },
+        [&](const node_addrof_expr& expr) {
+            if (const auto var = lvalue_root(*expr.expr)) {
+                aliased.address_taken.insert(var->name);
+            }
+            recurse(expr.expr);
+        },
+        [&](const node_slice_expr& expr) {
+            address_taken(*expr.expr);
+            recurse(expr.expr);
+            recurse(expr.lower);
+            recurse(expr.upper);
+        },
+        [&](const node_new_expr& expr) { recurse(expr.size); },
+        [&](const node_field_expr& expr) { recurse(expr.expr); },
+        [&](const node_deref_expr& expr) { recurse(expr.expr); },
+        [&](const node_subscript_expr& expr) { recurse(expr.expr); recurse(expr.index); },
+        [&](const auto&) {}
+    }, node);
+}
+
+auto find_aliased_vars(const compiler& com, const node_stmt& node, aliased_vars& aliased) -> void
+{
+    const auto expr = [&](const node_expr_ptr& e) { find_aliased_vars(com, *e, aliased); };
+    const auto stmt = [&](const node_stmt_ptr& s) { if (s) find_aliased_vars(com, *s, aliased); };
+
+    std::visit(overloaded{
+        [&](const node_sequence_stmt& node) { std::ranges::for_each(node.sequence, stmt); },
+        [&](const node_while_stmt& node) { expr(node.condition); stmt(node.body); },
+        [&](const node_if_stmt& node) { expr(node.condition); stmt(node.body); stmt(node.else_body); },
+        [&](const node_declaration_stmt& node) { expr(node.expr); },
+        [&](const node_assignment_stmt& node) { expr(node.position); expr(node.expr); },
+        [&](const node_expression_stmt& node) { expr(node.expr); },
+        [&](const node_return_stmt& node) { expr(node.return_value); },
+        [&](const node_delete_stmt& node) { expr(node.expr); },
+        [&](const auto&) {}
+    }, node);
+}
+
+auto find_loop_effects(const compiler& com, const node_expr& node, loop_effects& effects) -> void
+{
+    const auto recurse = [&](const node_expr_ptr& expr) { find_loop_effects(com, *expr, effects); };
+    const auto address_taken = [&](const node_expr& expr) {
+        if (const auto var = root_variable(com, expr)) {
+            effects.written.insert(var->name);
+        }
+    };
+
+    std::visit(overloaded{
+        [&](const node_unary_op_expr& expr) { recurse(expr.expr); },
+        [&](const node_binary_op_expr& expr) { recurse(expr.lhs); recurse(expr.rhs); },
+        [&](const node_function_call_expr& expr) {
+            // Builtins and constructors do not write to memory, user functions may
+            if (com.function_names.contains(expr.function_name)) {
+                effects.writes_memory = true;
+
+                // Lists and vecs may be passed as slices, which the function can write through
+                for (const auto& arg : expr.args) {
+                    const auto type = type_if_declared(com, *arg);
+                    if (is_lvalue_expr(*arg) && (!type || is_list_type(*type) || is_vec_type(*type))) {
+                        address_taken(*arg);
+                    }
+                }
+            }
+            std::ranges::for_each(expr.args, recurse);
+        },
+        [&](const node_member_function_call_expr& expr) {
+            // Vec member functions only change the vec and its elements, and some only read
+            const auto type = type_if_declared(com, *expr.expr);
+            if (type && is_vec_type(*type)) {
+                if (!is_vec_reader(expr.function_name)) {
+                    address_taken(*expr.expr);
+                    effects.writes_addressable = true;
+                }
+            } else {
+                address_taken(*expr.expr);
+                effects.writes_memory = true;
+            }
+            recurse(expr.expr);
+            std::ranges::for_each(expr.args, recurse);
+        },
+        [&](const node_list_expr& expr) { std::ranges::for_each(expr.elements, recurse); },
+        [&](const node_repeat_list_expr& expr) { recurse(expr.value); },
+        [&](const node_addrof_expr& expr) { address_taken(*expr.expr); recurse(expr.expr); },
+        [&](const node_slice_expr& expr) {
+            address_taken(*expr.expr);
+            recurse(expr.expr);
+            recurse(expr.lower);
+            recurse(expr.upper);
+        },
+        [&](const node_new_expr& expr) { recurse(expr.size); },
+        [&](const node_field_expr& expr) { recurse(expr.expr); },
+        [&](const node_deref_expr& expr) { recurse(expr.expr); },
+        [&](const node_subscript_expr& expr) { recurse(expr.expr); recurse(expr.index); },
+        [&](const auto&) {}
+    }, node);
+}
+
+auto find_loop_effects(const compiler& com, const node_stmt& node, loop_effects& effects) -> void
+{
+    const auto expr = [&](const node_expr_ptr& e) { find_loop_effects(com, *e, effects); };
+    const auto stmt = [&](const node_stmt_ptr& s) { if (s) find_loop_effects(com, *s, effects); };
+
+    std::visit(overloaded{
+        [&](const node_sequence_stmt& node) { std::ranges::for_each(node.sequence, stmt); },
+        [&](const node_while_stmt& node) { expr(node.condition); stmt(node.body); },
+        [&](const node_if_stmt& node) { expr(node.condition); stmt(node.body); stmt(node.else_body); },
+        [&](const node_declaration_stmt& node) {
+            // A pointer to the variable from an earlier iteration sees the new value
+            effects.written.insert(node.name);
+            // The type is not known yet, so a vec is treated like any other variable
+            if (!com.current_func
+                || com.current_func->aliased.address_taken.contains(node.name)
+                || com.current_func->aliased.unless_vec.contains(node.name))
+            {
+                effects.writes_addressable = true;
+            }
+            expr(node.expr);
+        },
+        [&](const node_assignment_stmt& node) {
+            if (const auto var = root_variable(com, *node.position)) {
+                effects.written.insert(var->name);
+                if (!is_unaliased_local(com, var->name)) {
+                    effects.writes_addressable = true;
+                }
+            } else {
+                effects.writes_memory = true;
+            }
+            expr(node.position);
+            expr(node.expr);
+        },
+        [&](const node_expression_stmt& node) { expr(node.expr); },
+        [&](const node_return_stmt& node) { expr(node.return_value); },
+        [&](const node_delete_stmt& node) { effects.writes_memory = true; expr(node.expr); },
+        [&](const auto&) {}
+    }, node);
+}
+
+auto is_loop_invariant(const compiler& com, const node_expr& node, const loop_effects& effects) -> bool
+{
+    const auto invariant = [&](const node_expr_ptr& expr) { return is_loop_invariant(com, *expr, effects); };
+    const auto writes_pointees = effects.writes_memory || effects.writes_addressable;
+    return std::visit(overloaded{
+        [](const node_literal_expr&) { return true; },
+        [&](const node_variable_expr& expr) {
+            if (effects.written.contains(expr.name)) return false;
+
+            // Writes through pointers or by called functions can only be ruled out for locals
+            // whose address is never taken
+            return !effects.writes_memory || is_unaliased_local(com, expr.name);
+        },
+        [&](const node_field_expr& expr) { return invariant(expr.expr); },
+        [&](const node_deref_expr& expr) { return !writes_pointees && invariant(expr.expr); },
+        [&](const node_subscript_expr& expr) {
+            if (may_store_elements_elsewhere(com, *expr.expr) && writes_pointees) return false;
+            return invariant(expr.expr) && invariant(expr.index);
+        },
+        [&](const node_unary_op_expr& expr) { return invariant(expr.expr); },
+        [&](const node_binary_op_expr& expr) { return invariant(expr.lhs) && invariant(expr.rhs); },
+        [](const auto&) { return false; }
+    }, node);
+}
+
+// Literals, variables and their fields are as cheap to load as a hidden variable would be
+auto is_worth_hoisting(const compiler& com, const node_expr& node) -> bool
+{
+    auto curr = &node;
+    while (const auto field = std::get_if<node_field_expr>(curr)) {
+        curr = field->expr.get();
+    }
+    if (std::holds_alternative<node_variable_expr>(*curr) || std::holds_alternative<node_literal_expr>(*curr)) {
+        return false;
+    }
+
+    // Only small values are copied, and never ones that would need destructing
+    const auto type = type_of_expr(com, node);
+    return com.types.size_of(type) <= 2 * sizeof(std::uint64_t) && !has_destructor(com, type);
+}
+
+// Returns true if evaluating the expression may stop the program, by dividing by zero or failing
+// a runtime check, or may do something that can be seen before it stops, as calls can.
+auto may_fail(const compiler& com, const node_expr& node) -> bool
+{
+    const auto recurse = [&](const node_expr_ptr& expr) { return expr && may_fail(com, *expr); };
+    const auto checked = com.options.check_bounds;
+    return std::visit(overloaded{
+        [&](const node_binary_op_expr& expr) {
+            return expr.token.text == tk_div || expr.token.text == tk_mod || recurse(expr.lhs) || recurse(expr.rhs);
+        },
+        [&](const node_function_call_expr& expr) {
+            return !com.types.contains(make_type(expr.function_name)) || std::ranges::any_of(expr.args, recurse);
+        },
+        [](const node_member_function_call_expr&) { return true; },
+        [&](const node_unary_op_expr& expr) { return recurse(expr.expr); },
+        [&](const node_list_expr& expr) { return std::ranges::any_of(expr.elements, recurse); },
+        [&](const node_repeat_list_expr& expr) { return recurse(expr.value); },
+        [&](const node_addrof_expr& expr) { return recurse(expr.expr); },
+        [&](const node_field_expr& expr) { return recurse(expr.expr); },
+        [&](const node_new_expr& expr) { return recurse(expr.size); },
+        [&](const node_deref_expr& expr) { return checked || recurse(expr.expr); },
+        [&](const node_subscript_expr& expr) { return checked || recurse(expr.expr) || recurse(expr.index); },
+        [&](const node_slice_expr& expr) {
+            return checked || recurse(expr.expr) || recurse(expr.lower) || recurse(expr.upper);
+        },
+        [](const auto&) { return false; }
+    }, node);
+}
+
+// Collects the largest loop invariant subexpressions of an expression that is evaluated on every
+// iteration. Only subexpressions that are compiled as values are considered, and the rhs of a
+// short circuiting operator is not always evaluated so is only hoisted along with the lhs.
+// Hoisted expressions are evaluated before the rest of the iteration, so one that may fail is
+// only hoisted if nothing before it may fail or have effects, which is tracked by failed_before.
+auto find_invariant_exprs(
+    const compiler& com,
+    const node_expr& node,
+    const loop_effects& effects,
+    std::vector<const node_expr*>& found,
+    bool& failed_before
+)
+    -> void
+{
+    if (is_loop_invariant(com, node, effects) && !(failed_before && may_fail(com, node))) {
+        if (!com.hoisted_exprs.contains(&node) && is_worth_hoisting(com, node)) {
+            found.push_back(&node);
+        } else {
+            failed_before = failed_before || may_fail(com, node);
+        }
+        return;
+    }
+
+    const auto recurse = [&](const node_expr_ptr& expr) { find_invariant_exprs(com, *expr, effects, found, failed_before); };
+    std::visit(overloaded{
+        [&](const node_binary_op_expr& expr) {
+            recurse(expr.lhs);
+            if (expr.token.text != tk_and && expr.token.text != tk_or) {
+                recurse(expr.rhs);
+            }
+        },
+        [&](const node_unary_op_expr& expr) { recurse(expr.expr); },
+        [&](const node_deref_expr& expr) { recurse(expr.expr); },
+        [&](const node_subscript_expr& expr) { recurse(expr.index); },
+        [&](const node_function_call_expr& expr) { std::ranges::for_each(expr.args, recurse); },
+        [&](const node_member_function_call_expr& expr) { std::ranges::for_each(expr.args, recurse); },
+        [](const auto&) {}
+    }, node);
+
+    // The parts that were not hoisted are evaluated in place, after any that were
+    failed_before = failed_before || may_fail(com, node);
+}
+
+// As above, for the statements at the start of a loop body that are executed on every iteration,
+// stopping at the first one that may branch. Returns false once such a statement is found.
+auto find_invariant_exprs(
+    const compiler& com,
+    const node_stmt& node,
+    const loop_effects& effects,
+    std::vector<const node_expr*>& found,
+    bool& failed_before
+)
+    -> bool
+{
+    const auto expr = [&](const node_expr_ptr& e) { find_invariant_exprs(com, *e, effects, found, failed_before); };
+    return std::visit(overloaded{
+        [&](const node_sequence_stmt& node) {
+            return std::ranges::all_of(node.sequence, [&](const auto& stmt) {
+                return find_invariant_exprs(com, *stmt, effects, found, failed_before);
+            });
+        },
+        [&](const node_declaration_stmt& node) { expr(node.expr); return true; },
+        [&](const node_assignment_stmt& node) {
+            expr(node.expr);
+            failed_before = failed_before || may_fail(com, *node.position); // Evaluated after the rhs
+            return true;
+        },
+        [&](const node_expression_stmt& node) { expr(node.expr); return true; },
+        [&](const node_while_stmt& node) { expr(node.condition); return false; },
+        [&](const node_if_stmt& node) { expr(node.condition); return false; },
+        [](const auto&) { return false; }
+    }, node);
+}
+
+auto same_expr(const node_expr& lhs, const node_expr& rhs) -> bool
+{
+    if (lhs.index() != rhs.index()) return false;
+    return std::visit(overloaded{
+        [&](const node_literal_expr& l) {
+            const auto& r = std::get<node_literal_expr>(rhs);
+            return l.value.type == r.value.type && l.value.data == r.value.data;
+        },
+        [&](const node_variable_expr& l) {
+            return l.name == std::get<node_variable_expr>(rhs).name;
+        },
+        [&](const node_field_expr& l) {
+            const auto& r = std::get<node_field_expr>(rhs);
+            return l.field_name == r.field_name && same_expr(*l.expr, *r.expr);
+        },
+        [&](const node_deref_expr& l) {
+            return same_expr(*l.expr, *std::get<node_deref_expr>(rhs).expr);
+        },
+        [&](const node_subscript_expr& l) {
+            const auto& r = std::get<node_subscript_expr>(rhs);
+            return same_expr(*l.expr, *r.expr) && same_expr(*l.index, *r.index);
+        },
+        [&](const node_unary_op_expr& l) {
+            const auto& r = std::get<node_unary_op_expr>(rhs);
+            return l.token.text == r.token.text && same_expr(*l.expr, *r.expr);
+        },
+        [&](const node_binary_op_expr& l) {
+            const auto& r = std::get<node_binary_op_expr>(rhs);
+            return l.token.text == r.token.text && same_expr(*l.lhs, *r.lhs) && same_expr(*l.rhs, *r.rhs);
+        },
+        [](const auto&) { return false; }
+    }, lhs);
+}
+
+// Evaluates each expression into a hidden variable in the current scope, which is used in place
+// of the expression until the loop ends. Expressions that were already hoisted for this loop
+// reuse the same variable. Returns the total size of the variables declared.
+auto hoist_exprs(
+    compiler& com,
+    const token& tok,
+    const std::vector<const node_expr*>& exprs,
+    std::vector<const node_expr*>& hoisted
+)
+    -> std::size_t
+{
+    auto size = std::size_t{0};
+    for (const auto expr : exprs) {
+        const auto same = std::ranges::find_if(hoisted, [&](const node_expr* e) { return same_expr(*e, *expr); });
+        if (same != hoisted.end()) {
+            com.hoisted_exprs.emplace(expr, com.hoisted_exprs.at(*same));
+            hoisted.push_back(expr);
+            continue;
+        }
+
+        const auto var = node_variable_expr{ .name=std::format("# invariant {}", com.hoisted_count++), .token=tok };
+        size += align_next_var(com, *expr);
+        const auto type = compile_expr_val(com, *expr);
+        declare_var(com, tok, var.name, type);
+        save_variable(com, tok, var.name);
+        com.hoisted_exprs.emplace(expr, var);
+        hoisted.push_back(expr);
+        size += com.types.size_of(type);
+    }
+    return size;
+}
+
+// Records the facts of the form 'var < literal' that hold when the condition is true.
+auto add_range_facts(compiler& com, const node_expr& condition, const void* owner) -> void
+{
+    const auto binary = std::get_if<node_binary_op_expr>(&condition);
+    if (!binary) return;
+
+    if (binary->token.text == tk_and) {
+        add_range_facts(com, *binary->lhs, owner);
+        add_range_facts(com, *binary->rhs, owner);
+    }
+    else if (binary->token.text == tk_lt) {
+        const auto var = std::get_if<node_variable_expr>(&*binary->lhs);
+        const auto bound = literal_u64(*binary->rhs);
+        if (var && bound && !find_inline_arg(com, var->name)) {
+            com.range_facts.push_back({ .name=var->name, .bound=*bound, .owner=owner });
+        }
+    }
+}
+
+auto remove_range_facts(compiler& com, const void* owner) -> void
+{
+    std::erase_if(com.range_facts, [&](const range_fact& fact) { return fact.owner == owner; });
+}
+
+// Facts no longer hold once the statement may have modified their variable. Compound statements
+// are checked as a whole before any of their parts are compiled, which is needed for loops.
+auto invalidate_range_facts(compiler& com, const node_stmt& node) -> void
+{
+    auto effects = loop_effects{};
+    find_loop_effects(com, node, effects);
+    std::erase_if(com.range_facts, [&](const range_fact& fact) {
+        return effects.written.contains(fact.name)
+            || (effects.writes_memory && !is_unaliased_local(com, fact.name));
+    });
+}
+
+// While loops are rotated so that each iteration only executes a single branch. The condition
+// is checked once before entering the loop, and then again after each iteration:
+//
+//       <condition>
+//       JUMP_RELATIVE_IF_FALSE -> end
+// body: <body>
+//       <condition>                 <- continue statements jump here
+//       JUMP_RELATIVE_IF_TRUE -> body
+// end:                              <- break statements jump here
+//
+// With optimisations, loop invariant expressions in the condition are stored in hidden variables
+// before the guard, and those at the start of the body after it, so neither are evaluated unless
+// they would have been anyway. The variables after the guard are popped separately at the end.
 void compile_stmt(compiler& com, const node_while_stmt& node)
 {
     current_vars(com).push_scope(var_scope::scope_type::while_stmt);
 
-    const auto begin_pos = std::ssize(com.program);
+    auto cond_exprs = std::vector<const node_expr*>{};
+    auto body_exprs = std::vector<const node_expr*>{};
+    if (com.options.hoist_loop_invariants) {
+        auto effects = loop_effects{};
+        find_loop_effects(com, *node.condition, effects);
+        find_loop_effects(com, *node.body, effects);
+        // The body exprs are hoisted after the condition, so only the body can come before them
+        auto cond_failed_before = false;
+        auto body_failed_before = false;
+        find_invariant_exprs(com, *node.condition, effects, cond_exprs, cond_failed_before);
+        find_invariant_exprs(com, *node.body, effects, body_exprs, body_failed_before);
+    }
+
+    auto hoisted = std::vector<const node_expr*>{};
+    hoist_exprs(com, node.token, cond_exprs, hoisted);
+
     const auto cond_type = compile_expr_val(com, *node.condition);
     compiler_assert(cond_type == bool_type(), node.token, "while-stmt expected bool, got {}", cond_type);
-
-    const auto jump_pos = append_op(com, op_jump_if_false{});
+    const auto guard_pos = append_op(com, op_jump_if_false{});
+    const auto body_hoisted_size = hoist_exprs(com, node.token, body_exprs, hoisted);
 
     com.control_flow.emplace();
+    const auto body_pos = std::ssize(com.program.code);
+    add_range_facts(com, *node.condition, &node);
     compile_stmt(com, *node.body);
-    const auto end_pos = std::ssize(com.program);
-    com.program.emplace_back(op_jump{ .jump=(begin_pos - end_pos) });
+    remove_range_facts(com, &node);
+
+    const auto continue_pos = std::ssize(com.program.code);
+    compile_expr_val(com, *node.condition);
+    const auto loop_pos = std::ssize(com.program.code);
+    com.program.code.emplace_back(op_jump_if_true{ .jump=(body_pos - loop_pos) });
+    const auto end_pos = std::ssize(com.program.code);
+    if (body_hoisted_size > 0) {
+        com.program.code.emplace_back(op_pop{body_hoisted_size});
+    }
 
-    std::get<op_jump_if_false>(com.program[jump_pos]).jump = end_pos + 1 - jump_pos;
+    const auto skip_pos = std::ssize(com.program.code);
+    std::get<op_jump_if_false>(com.program.code[guard_pos]).jump = skip_pos - guard_pos;
 
     const auto& control_flow = com.control_flow.top();
     for (const auto idx : control_flow.break_stmts) {
-        std::get<op_jump>(com.program[idx]).jump = end_pos + 1 - idx; // Jump past end
+        std::get<op_jump>(com.program.code[idx]).jump = end_pos - idx; // Jump past end
     }
     for (const auto idx : control_flow.continue_stmts) {
-        std::get<op_jump>(com.program[idx]).jump = begin_pos - idx; // Jump to start
+        std::get<op_jump>(com.program.code[idx]).jump = continue_pos - idx; // Jump to condition
     }
     com.control_flow.pop();
 
-    const auto scope_size = current_vars(com).pop_scope();
+    for (const auto expr : hoisted) {
+        com.hoisted_exprs.erase(expr);
+    }
+    const auto scope_size = current_vars(com).pop_scope() - body_hoisted_size;
     if (scope_size > 0) {
-        com.program.emplace_back(op_pop{scope_size});
+        com.program.code.emplace_back(op_pop{scope_size});
     }
 }
 
@@ -803,15 +2401,17 @@ void compile_stmt(compiler& com, const node_if_stmt& node)
     compiler_assert(cond_type == bool_type(), node.token, "if-stmt expected bool, got {}", cond_type);
 
     const auto jump_pos = append_op(com, op_jump_if_false{});
+    add_range_facts(com, *node.condition, &node);
     compile_stmt(com, *node.body);
+    remove_range_facts(com, &node);
 
     if (node.else_body) {
         const auto else_pos = append_op(com, op_jump{});
         compile_stmt(com, *node.else_body);
-        std::get<op_jump_if_false>(com.program[jump_pos]).jump = else_pos + 1 - jump_pos; // Jump into the else block if false
-        std::get<op_jump>(com.program[else_pos]).jump = com.program.size() - else_pos; // Jump past the end if false
+        std::get<op_jump_if_false>(com.program.code[jump_pos]).jump = else_pos + 1 - jump_pos; // Jump into the else block if false
+        std::get<op_jump>(com.program.code[else_pos]).jump = com.program.code.size() - else_pos; // Jump past the end if false
     } else {
-        std::get<op_jump_if_false>(com.program[jump_pos]).jump = com.program.size() - jump_pos; // Jump past the end if false
+        std::get<op_jump_if_false>(com.program.code[jump_pos]).jump = com.program.code.size() - jump_pos; // Jump past the end if false
     }
 }
 
@@ -822,7 +2422,7 @@ void compile_stmt(compiler& com, const node_struct_stmt& node)
         verify_real_type(com, node.token, field.type);
     }
 
-    com.types.add(make_type(node.name), node.fields);
+    com.types.add(make_type(node.name), node.fields, node.is_soa);
     for (const auto& function : node.functions) {
         compile_stmt(com, *function);
     }
@@ -844,8 +2444,20 @@ void compile_stmt(compiler& com, const node_continue_stmt&)
 
 void compile_stmt(compiler& com, const node_declaration_stmt& node)
 {
+    const auto slot = std::exchange(com.reusable_slot, std::nullopt);
+    align_next_var(com, *node.expr);
     const auto type = compile_expr_val(com, *node.expr);
-    declare_var(com, node.token, node.name, type);
+
+    // The value is saved into the old slot rather than left on top of the stack
+    const auto old_type = slot ? get_var_type(com, node.token, *slot) : type;
+    const auto can_reuse = slot
+        && com.types.size_of(old_type) == com.types.size_of(type)
+        && slot_alignment(com, old_type) >= slot_alignment(com, type)
+        && !has_destructor(com, type)
+        && current_vars(com).reuse(*slot, node.name, type);
+    if (!can_reuse) {
+        declare_var(com, node.token, node.name, type);
+    }
     save_variable(com, node.token, node.name);
 }
 
@@ -854,7 +2466,13 @@ void compile_stmt(compiler& com, const node_assignment_stmt& node)
     const auto rhs = compile_expr_val(com, *node.expr);
     const auto lhs = compile_expr_ptr(com, *node.position);
     compiler_assert(lhs == rhs, node.token, "cannot assign a {} to a {}\n", rhs, lhs);
-    com.program.emplace_back(op_save{ .size=com.types.size_of(lhs) });
+
+    // The old elements of a vec are freed before it is overwritten
+    if (is_vec_type(lhs)) {
+        com.program.code.emplace_back(op_repeat{ .size=sizeof(std::uint64_t), .count=2 });
+        com.program.code.emplace_back(op_vec_drop{});
+    }
+    com.program.code.emplace_back(op_save{ .size=com.types.size_of(lhs) });
 }
 
 auto make_key(compiler& com, const token& tok, const std::string& name, const signature& sig)
@@ -869,40 +2487,258 @@ auto make_key(compiler& com, const token& tok, const std::string& name, const si
     return key;
 }
 
+enum class inline_context
+{
+    value,   // The expression is evaluated
+    lvalue,  // The address of the expression is used to access a field or element
+    address, // The address of the expression is taken
+};
+
+// Records the parameter uses in the expression, and returns the number of nodes in it, or
+// nullopt if the expression cannot be inlined. An inlinable expression only refers to the
+// parameters, does not take their address and does not call any user defined functions.
+auto analyse_inline_expr(
+    const compiler& com,
+    const signature& sig,
+    const node_expr& node,
+    inline_context ctx,
+    std::vector<inline_param>& params
+)
+    -> std::optional<std::size_t>
+{
+    const auto sub_ctx = ctx == inline_context::address ? ctx : inline_context::lvalue;
+    const auto analyse = [&](const node_expr& expr, inline_context c) {
+        return analyse_inline_expr(com, sig, expr, c, params);
+    };
+
+    // Sums the sizes of the given subexpressions, plus one for the current node
+    const auto combine = [](std::initializer_list<std::optional<std::size_t>> sizes) {
+        auto total = std::size_t{1};
+        for (const auto& size : sizes) {
+            if (!size) return std::optional<std::size_t>{};
+            total += *size;
+        }
+        return std::optional<std::size_t>{total};
+    };
+    const auto combine_all = [&](const std::vector<node_expr_ptr>& exprs) {
+        auto total = std::optional<std::size_t>{1};
+        for (const auto& expr : exprs) {
+            const auto size = analyse(*expr, inline_context::value);
+            total = total && size ? std::optional<std::size_t>{*total + *size} : std::nullopt;
+        }
+        return total;
+    };
+
+    return std::visit(overloaded{
+        [&](const node_literal_expr&) -> std::optional<std::size_t> { return 1; },
+        [&](const node_variable_expr& expr) -> std::optional<std::size_t> {
+            for (std::size_t i = 0; i != sig.params.size(); ++i) {
+                if (sig.params[i].name == expr.name) {
+                    if (ctx == inline_context::address) return std::nullopt;
+                    ++params[i].uses;
+                    params[i].needs_lvalue |= ctx == inline_context::lvalue;
+                    return 1;
+                }
+            }
+            return std::nullopt;
+        },
+        [&](const node_field_expr& expr) { return combine({analyse(*expr.expr, sub_ctx)}); },
+        [&](const node_subscript_expr& expr) {
+            return combine({analyse(*expr.expr, sub_ctx), analyse(*expr.index, inline_context::value)});
+        },
+        [&](const node_deref_expr& expr) { return combine({analyse(*expr.expr, inline_context::value)}); },
+        [&](const node_addrof_expr& expr) { return combine({analyse(*expr.expr, inline_context::address)}); },
+        [&](const node_unary_op_expr& expr) { return combine({analyse(*expr.expr, inline_context::value)}); },
+        [&](const node_binary_op_expr& expr) {
+            return combine({analyse(*expr.lhs, inline_context::value), analyse(*expr.rhs, inline_context::value)});
+        },
+        [&](const node_sizeof_expr& expr) { return combine({analyse(*expr.expr, inline_context::value)}); },
+        [&](const node_repeat_list_expr& expr) { return combine({analyse(*expr.value, inline_context::value)}); },
+        [&](const node_list_expr& expr) { return combine_all(expr.elements); },
+        [&](const node_function_call_expr& expr) -> std::optional<std::size_t> {
+            if (com.function_names.contains(expr.function_name)) {
+                return std::nullopt;
+            }
+            return combine_all(expr.args);
+        },
+        [&](const auto&) -> std::optional<std::size_t> { return std::nullopt; }
+    }, node);
+}
+
+// Returns the inline info for functions whose body is a single return statement of a small
+// enough expression, or one of any size if the function has the inline hint.
+auto make_inline_info(
+    const compiler& com, const signature& sig, const node_stmt& body, bool is_inline
+)
+    -> std::optional<inline_info>
+{
+    const auto* stmt = &body;
+    if (const auto seq = std::get_if<node_sequence_stmt>(stmt)) {
+        if (seq->sequence.size() != 1) return std::nullopt;
+        stmt = seq->sequence.front().get();
+    }
+    const auto ret = std::get_if<node_return_stmt>(stmt);
+    if (!ret) return std::nullopt;
+
+    auto params = std::vector<inline_param>(sig.params.size());
+    const auto size = analyse_inline_expr(com, sig, *ret->return_value, inline_context::value, params);
+    if (!size || (*size > inline_threshold && !is_inline)) return std::nullopt;
+
+    return inline_info{ .expr=ret->return_value.get(), .params=params };
+}
+
+auto contains_pointer(const compiler& com, const type_name& type) -> bool
+{
+    if (is_ptr_type(type) || is_slice_type(type) || is_vec_type(type)) {
+        return true;
+    }
+    if (is_list_type(type)) {
+        return contains_pointer(com, inner_type(type));
+    }
+    return std::ranges::any_of(com.types.fields_of(type), [&](const field& f) {
+        return contains_pointer(com, f.type);
+    });
+}
+
+// A function is pure if calling it with the same args always gives the same result and has no
+// other effects. This is checked on the ops of the compiled function, which starts at the given
+// position. Returns the reason the function is not pure, if any.
+auto find_impurity(const compiler& com, const signature& sig, std::size_t begin_pos)
+    -> std::optional<std::string>
+{
+    for (const auto& param : sig.params) {
+        if (contains_pointer(com, param.type)) {
+            return std::format("it takes a pointer in '{}'", param.name);
+        }
+    }
+    if (contains_pointer(com, sig.return_type)) {
+        return std::string{"it returns a pointer"};
+    }
+
+    const auto is_pure_call = [&](std::size_t ptr) {
+        return ptr == begin_pos + 1 || com.pure_functions.contains(ptr - 1);
+    };
+
+    for (std::size_t pos = begin_pos + 1; pos != com.program.code.size(); ++pos) {
+        const auto reason = std::visit(overloaded{
+            [&](const op_push_global_addr&) -> std::optional<std::string> {
+                return "it uses a global variable";
+            },
+            [&](const op_allocate&) -> std::optional<std::string> {
+                return "it allocates memory";
+            },
+            [&](const op_deallocate&) -> std::optional<std::string> {
+                return "it deallocates memory";
+            },
+            [&](const op_vec_push&) -> std::optional<std::string> {
+                return "it allocates memory";
+            },
+            [&](const op_vec_reserve&) -> std::optional<std::string> {
+                return "it allocates memory";
+            },
+            [&](const op_vec_append&) -> std::optional<std::string> {
+                return "it allocates memory";
+            },
+            [&](const op_vec_drop&) -> std::optional<std::string> {
+                return "it deallocates memory";
+            },
+            [&](const op_vec_copy&) -> std::optional<std::string> {
+                return "it allocates memory";
+            },
+            [&](const op_map_file&) -> std::optional<std::string> {
+                return "it reads a file";
+            },
+            [&](const op_builtin_call& op) -> std::optional<std::string> {
+                if (op.name.starts_with("print")) return "it prints";
+                return std::nullopt;
+            },
+            [&](const op_function_call& op) -> std::optional<std::string> {
+                if (!is_pure_call(op.ptr)) return std::format("it calls '{}' which is not pure", op.name);
+                return std::nullopt;
+            },
+            [&](const op_tail_call& op) -> std::optional<std::string> {
+                if (!is_pure_call(op.ptr)) return std::format("it calls '{}' which is not pure", op.name);
+                return std::nullopt;
+            },
+            [&](const auto&) -> std::optional<std::string> { return std::nullopt; }
+        }, com.program.code[pos]);
+
+        if (reason) return reason;
+    }
+    return std::nullopt;
+}
+
 void compile_function_body(
     compiler& com,
     const token& tok,
     const std::string& name,
     const signature& sig,
-    const node_stmt_ptr& body)
+    const node_stmt_ptr& body,
+    bool is_inline,
+    bool is_memo)
 {
     const auto key = make_key(com, tok, name, sig);
 
-    const auto begin_pos = append_op(com, op_function{ .name=key.name });
+    const auto begin_pos = append_op(com, op_function{
+        .name=key.name, .args_size=signature_args_size(com, sig)
+    });
     com.functions[key] = { .sig=sig, .ptr=begin_pos, .tok=tok };
 
     com.current_func.emplace(current_function{ .vars={}, .return_type=sig.return_type });
+    find_aliased_vars(com, *body, com.current_func->aliased);
+    auto outer_range_facts = std::exchange(com.range_facts, {}); // They refer to outer variables
+    if (is_memo) {
+        // Cached results are byte copies, which would share the memory that a vec owns
+        compiler_assert(
+            !has_destructor(com, sig.return_type), tok,
+            "memo function '{}' cannot return '{}', which owns memory", name, sig.return_type
+        );
+        com.current_func->memo_id = com.memo_count++;
+        com.program.code.emplace_back(op_memo_enter{
+            .name=key.name,
+            .id=*com.current_func->memo_id,
+            .args_size=signature_args_size(com, sig) - 2 * sizeof(std::uint64_t)
+        });
+    }
     declare_var(com, tok, "# old_base_ptr", u64_type()); // Store the old base ptr
     declare_var(com, tok, "# old_prog_ptr", u64_type()); // Store the old program ptr
     for (const auto& arg : sig.params) {
+        current_vars(com).pad_to(slot_alignment(com, arg.type)); // The caller pushes the padding
         declare_var(com, tok, arg.name, arg.type);
     }
     compile_stmt(com, *body);
+    const auto memo_id = com.current_func->memo_id;
     com.current_func.reset();
+    com.range_facts = std::move(outer_range_facts);
 
     if (!function_ends_with_return(*body)) {
         // A function returning null does not need a final return statement, and in this case
         // we manually add a return value of null here.
         if (sig.return_type == null_type()) {
             destruct_on_return(com);
-            com.program.emplace_back(op_load_bytes{{std::byte{0}}});
-            com.program.emplace_back(op_return{ .size=1 });
+            com.program.code.emplace_back(op_load_bytes{{std::byte{0}}});
+            if (memo_id) {
+                com.program.code.emplace_back(op_memo_store{ .id=*memo_id, .result_size=1 });
+            }
+            com.program.code.emplace_back(op_return{ .size=1 });
         } else {
             compiler_error(tok, "function '{}' does not end in a return statement", key.name);
         }
     }
 
-    std::get<op_function>(com.program[begin_pos]).jump = com.program.size();
+    std::get<op_function>(com.program.code[begin_pos]).jump = com.program.code.size();
+
+    const auto impurity = find_impurity(com, sig, begin_pos);
+    if (!impurity) {
+        com.pure_functions.insert(begin_pos);
+    } else if (is_memo) {
+        compiler_error(tok, "memo function '{}' must be pure, but {}", key.name, *impurity);
+    }
+
+    // Inlining a memoised function would skip the cache
+    if (auto info = make_inline_info(com, sig, *body, is_inline); info && !is_memo) {
+        com.inline_functions[key] = std::move(*info);
+    }
 }
 
 void compile_stmt(compiler& com, const node_function_def_stmt& node)
@@ -911,7 +2747,7 @@ void compile_stmt(compiler& com, const node_function_def_stmt& node)
         compiler_error(node.token, "'{}' cannot be a function name, it is a type def", node.name);
     }
     com.function_names.insert(node.name);
-    compile_function_body(com, node.token, node.name, node.sig, node.body);
+    compile_function_body(com, node.token, node.name, node.sig, node.body, node.is_inline, node.is_memo);
 }
 
 void compile_stmt(compiler& com, const node_member_function_def_stmt& node)
@@ -924,8 +2760,9 @@ void compile_stmt(compiler& com, const node_member_function_def_stmt& node)
         compiler_error(node.token, "first arg to member function should be '{}', got '{}'", expected, actual);
     }
 
+    // The parser rejects memo on member functions, since self is passed by pointer
     const auto name = std::format("{}::{}", node.struct_name, node.function_name);
-    compile_function_body(com, node.token, name, node.sig, node.body);
+    compile_function_body(com, node.token, name, node.sig, node.body, node.is_inline, false);
 }
 
 void compile_stmt(compiler& com, const node_return_stmt& node)
@@ -933,8 +2770,24 @@ void compile_stmt(compiler& com, const node_return_stmt& node)
     if (!com.current_func) {
         compiler_error(node.token, "return statements can only be within functions");
     }
-    destruct_on_return(com, &node);
-    const auto return_type = compile_expr_val(com, *node.return_value);
+
+    // Returning a local variable copies it straight into the return slot at the base of the
+    // frame rather than pushing a copy of it first. Memoised functions need the result on the
+    // stack to store it.
+    const auto var = std::get_if<node_variable_expr>(&*node.return_value);
+    const auto returned = var ? com.current_func->vars.find(var->name) : std::nullopt;
+    const auto local = com.current_func->memo_id ? std::nullopt : returned;
+
+    // A returned local is not destructed, so it is moved out rather than copied
+    auto return_type = type_name{};
+    if (local) {
+        return_type = local->type;
+    } else if (returned) {
+        load_variable(com, node.token, var->name);
+        return_type = returned->type;
+    } else {
+        return_type = compile_expr_val(com, *node.return_value);
+    }
     if (return_type != com.current_func->return_type) {
         compiler_error(
             node.token,
@@ -942,37 +2795,78 @@ void compile_stmt(compiler& com, const node_return_stmt& node)
             com.current_func->return_type, return_type
         );
     }
-    com.program.emplace_back(op_return{ .size=com.types.size_of(return_type) });
+
+    // Objects are destructed after the return value is evaluated, since it may read from them
+    destruct_on_return(com, &node);
+
+    // If the value is the result of a call to another function, the call can reuse the current
+    // frame, unless there are destructors to run after it, a local in scope may have been passed
+    // to it by pointer or the function is memoised and must store its result before returning.
+    // The return op is kept so that the statement still ends in a return.
+    const auto call = std::get_if<node_function_call_expr>(&*node.return_value);
+    const auto is_user_call = std::holds_alternative<node_member_function_call_expr>(*node.return_value)
+        || (call && !com.types.contains(make_type(call->function_name)));
+    const auto can_reuse_frame = !com.current_func->memo_id && !has_aliased_local(com);
+    if (is_user_call && can_reuse_frame && std::holds_alternative<op_function_call>(com.program.code.back())) {
+        const auto op = std::get<op_function_call>(com.program.code.back());
+        com.program.code.back().emplace<op_tail_call>(op.name, op.ptr, op.args_size, op.return_size);
+    }
+    if (const auto id = com.current_func->memo_id) {
+        com.program.code.emplace_back(op_memo_store{ .id=*id, .result_size=com.types.size_of(return_type) });
+    }
+    com.program.code.emplace_back(op_return{
+        .size=com.types.size_of(return_type),
+        .local=local ? std::optional{local->location} : std::nullopt
+    });
 }
 
 void compile_stmt(compiler& com, const node_expression_stmt& node)
 {
     const auto type = compile_expr_val(com, *node.expr);
-    com.program.emplace_back(op_pop{ .size=com.types.size_of(type) });
+    com.program.code.emplace_back(op_pop{ .size=com.types.size_of(type) });
 }
 
 void compile_stmt(compiler& com, const node_delete_stmt& node)
 {
     const auto type = compile_expr_val(com, *node.expr);
+    if (is_slice_type(type) && com.types.is_soa(inner_type(type))) {
+        com.program.code.emplace_back(op_pop{ .size = sizeof(std::uint64_t) }); // size
+        com.program.code.emplace_back(op_deallocate{});
+        return;
+    }
     compiler_assert(is_ptr_type(type), node.token, "delete requires a ptr, got {}\n", type);
-    com.program.emplace_back(op_deallocate{});
+    com.program.code.emplace_back(op_deallocate{});
 }
 
 auto compile_expr_val(compiler& com, const node_expr& expr) -> type_name
 {
+    if (const auto it = com.hoisted_exprs.find(&expr); it != com.hoisted_exprs.end()) {
+        return compile_expr_val(com, it->second);
+    }
     return std::visit([&](const auto& node) { return compile_expr_val(com, node); }, expr);
 }
 
 auto compile_stmt(compiler& com, const node_stmt& root) -> void
 {
+    if (!com.range_facts.empty() && !std::holds_alternative<node_sequence_stmt>(root)) {
+        invalidate_range_facts(com, root);
+    }
     std::visit([&](const auto& node) { compile_stmt(com, node); }, root);
 }
 
 }
 
-auto compile(const node_stmt_ptr& root) -> program
+auto compile(const node_stmt_ptr& root, const compile_options& options) -> program
 {
     auto com = compiler{};
+    com.options = options;
+    com.types = type_store{options.aligned_layout};
+    com.program.frame_alignment = com.types.max_align();
+    com.program.track_allocations = options.check_bounds;
+    com.types.add(file_view_type(), {
+        { .name="data", .type=concrete_ptr_type(char_type()) },
+        { .name="size", .type=u64_type() }
+    });
     compile_stmt(com, *root);
     return com.program;
 }
@@ -2,8 +2,32 @@
 #include "ast.hpp"
 #include "program.hpp"
 
+#include <filesystem>
+
 namespace anzu {
 
-auto compile(const node_stmt_ptr& root) -> anzu::program;
+struct compile_options
+{
+    // Evaluate calls to pure functions with literal args at compile time
+    bool evaluate_pure_calls = false;
+
+    // Move loop invariant expressions out of while loops
+    bool hoist_loop_invariants = false;
+
+    // Check list subscripts against the size of the list at runtime
+    bool check_bounds = false;
+
+    // Let variables reuse the stack slots of earlier variables that are no longer used
+    bool reuse_stack_slots = false;
+
+    // Give struct fields and heap blocks their natural alignment rather than packing them
+    bool aligned_layout = false;
+
+    // The directory of the source file, which relative paths given to embed and read_file are
+    // resolved against
+    std::filesystem::path source_dir;
+};
+
+auto compile(const node_stmt_ptr& root, const compile_options& options = {}) -> anzu::program;
 
 }
\ No newline at end of file
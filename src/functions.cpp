@@ -5,9 +5,13 @@
 #include "utility/overloaded.hpp"
 #include "utility/memory.hpp"
 
+#include <algorithm>
+#include <array>
 #include <unordered_map>
 #include <string>
 #include <functional>
+#include <numeric>
+#include <type_traits>
 #include <utility>
 
 namespace anzu {
@@ -55,6 +59,73 @@ auto builtin_println_null(std::vector<std::byte>& mem) -> void
     mem.back() = std::byte{0}; // returns null
 }
 
+template <typename T>
+auto read_as(const std::byte* data) -> T
+{
+    auto ret = T{};
+    std::memcpy(&ret, data, sizeof(T));
+    return ret;
+}
+
+// Formats a value of the given type, which takes up size bytes.
+auto format_value(const std::byte* data, const type_name& type, std::size_t size) -> std::string
+{
+    if (std::holds_alternative<type_list>(type)) {
+        const auto count = std::get<type_list>(type).count;
+        return std::string(reinterpret_cast<const char*>(data), count);
+    }
+    if (std::holds_alternative<type_ptr>(type)) {
+        return std::format("{}", read_as<std::uint64_t>(data));
+    }
+    if (is_simd_type(type)) {
+        const auto lane_type = inner_type(type);
+        const auto lane_size = size / simd_lanes(type);
+        auto out = std::string{"["};
+        for (std::size_t i = 0; i != simd_lanes(type); ++i) {
+            if (i != 0) out += ", ";
+            out += format_value(data + i * lane_size, lane_type, lane_size);
+        }
+        return out + "]";
+    }
+    if (type == i8_type()) {
+        return std::format("{}", read_as<std::int8_t>(data));
+    }
+    if (type == i16_type()) {
+        return std::format("{}", read_as<std::int16_t>(data));
+    }
+    if (type == i32_type()) {
+        return std::format("{}", read_as<std::int32_t>(data));
+    }
+    if (type == i64_type()) {
+        return std::format("{}", read_as<std::int64_t>(data));
+    }
+    if (type == u8_type()) {
+        return std::format("{}", read_as<std::uint8_t>(data));
+    }
+    if (type == u16_type()) {
+        return std::format("{}", read_as<std::uint16_t>(data));
+    }
+    if (type == u32_type()) {
+        return std::format("{}", read_as<std::uint32_t>(data));
+    }
+    if (type == u64_type()) {
+        return std::format("{}", read_as<std::uint64_t>(data));
+    }
+    if (type == f32_type()) {
+        return std::format("{}", read_as<float>(data));
+    }
+    if (type == f64_type()) {
+        return std::format("{}", read_as<double>(data));
+    }
+    if (type == char_type()) {
+        return std::string(1, static_cast<char>(*data));
+    }
+    if (type == bool_type()) {
+        return *data == std::byte{1} ? "true" : "false";
+    }
+    return "null";
+}
+
 template <typename T>
 auto builtin_print(std::vector<std::byte>& mem) -> void
 {
@@ -69,6 +140,111 @@ auto builtin_println(std::vector<std::byte>& mem) -> void
     mem.push_back(std::byte{0}); // returns null
 }
 
+template <typename T>
+auto add_print_builtins(builtin_map& builtins) -> void
+{
+    builtins.emplace(
+        builtin_key{ .name = "print", .args = { to_type_name<T>() } },
+        builtin_val{ .ptr = builtin_print<T>, .return_type = null_type() }
+    );
+    builtins.emplace(
+        builtin_key{ .name = "println", .args = { to_type_name<T>() } },
+        builtin_val{ .ptr = builtin_println<T>, .return_type = null_type() }
+    );
+}
+
+template <typename From, typename To>
+auto builtin_convert(std::vector<std::byte>& mem) -> void
+{
+    push_value(mem, static_cast<To>(pop_value<From>(mem)));
+}
+
+// Numeric values are converted to another numeric type by calling the name of the type as a
+// function, eg: u8(x).
+template <typename To, typename... From>
+auto add_conversion_builtins(builtin_map& builtins) -> void
+{
+    (builtins.emplace(
+        builtin_key{ .name = to_string(to_type_name<To>()), .args = { to_type_name<From>() } },
+        builtin_val{ .ptr = builtin_convert<From, To>, .return_type = to_type_name<To>() }
+    ), ...);
+}
+
+// Adds the conversions between every pair of the given types
+template <typename... Types>
+auto add_conversion_builtins_between(builtin_map& builtins) -> void
+{
+    (add_conversion_builtins<Types, Types...>(builtins), ...);
+}
+
+// Horizontal reductions of SIMD vectors. As with the element-wise operators, these are plain
+// loops over a fixed number of lanes that the C++ compiler is free to vectorise.
+template <typename T, std::size_t N, typename Op>
+auto builtin_reduce(std::vector<std::byte>& mem) -> void
+{
+    static constexpr auto op = Op{};
+    const auto vec = pop_value<std::array<T, N>>(mem);
+    auto acc = vec[0];
+    for (std::size_t i = 1; i != N; ++i) {
+        acc = static_cast<T>(op(acc, vec[i]));
+    }
+    push_value(mem, acc);
+}
+
+struct min_op
+{
+    template <typename T>
+    constexpr auto operator()(T lhs, T rhs) const -> T { return std::min(lhs, rhs); }
+};
+
+struct max_op
+{
+    template <typename T>
+    constexpr auto operator()(T lhs, T rhs) const -> T { return std::max(lhs, rhs); }
+};
+
+template <typename T, std::size_t N>
+auto add_simd_builtins_with_lanes(builtin_map& builtins) -> void
+{
+    const auto type = simd_type(to_type_name<T>(), N);
+    if constexpr (std::is_same_v<T, bool>) {
+        builtins.emplace(
+            builtin_key{ .name = "any", .args = { type } },
+            builtin_val{ .ptr = builtin_reduce<T, N, std::logical_or<>>, .return_type = bool_type() }
+        );
+        builtins.emplace(
+            builtin_key{ .name = "all", .args = { type } },
+            builtin_val{ .ptr = builtin_reduce<T, N, std::logical_and<>>, .return_type = bool_type() }
+        );
+    } else {
+        builtins.emplace(
+            builtin_key{ .name = "reduce_add", .args = { type } },
+            builtin_val{ .ptr = builtin_reduce<T, N, std::plus<>>, .return_type = to_type_name<T>() }
+        );
+        builtins.emplace(
+            builtin_key{ .name = "reduce_min", .args = { type } },
+            builtin_val{ .ptr = builtin_reduce<T, N, min_op>, .return_type = to_type_name<T>() }
+        );
+        builtins.emplace(
+            builtin_key{ .name = "reduce_max", .args = { type } },
+            builtin_val{ .ptr = builtin_reduce<T, N, max_op>, .return_type = to_type_name<T>() }
+        );
+    }
+}
+
+// Adds the reductions for vectors of every supported lane count of each of the given types
+template <typename... Types>
+auto add_simd_builtins(builtin_map& builtins) -> void
+{
+    const auto add_for = [&]<typename T>(std::type_identity<T>) {
+        add_simd_builtins_with_lanes<T, 2>(builtins);
+        add_simd_builtins_with_lanes<T, 4>(builtins);
+        add_simd_builtins_with_lanes<T, 8>(builtins);
+        add_simd_builtins_with_lanes<T, 16>(builtins);
+    };
+    (add_for(std::type_identity<Types>{}), ...);
+}
+
 }
 
 auto construct_builtin_map() -> builtin_map
@@ -143,6 +319,25 @@ auto construct_builtin_map() -> builtin_map
         builtin_val{ .ptr = builtin_println<std::int64_t>, .return_type = null_type() }
     );
 
+    add_print_builtins<std::int8_t>(builtins);
+    add_print_builtins<std::int16_t>(builtins);
+    add_print_builtins<std::uint8_t>(builtins);
+    add_print_builtins<std::uint16_t>(builtins);
+    add_print_builtins<std::uint32_t>(builtins);
+    add_print_builtins<float>(builtins);
+
+    add_conversion_builtins_between<
+        std::int8_t, std::int16_t, std::int32_t, std::int64_t,
+        std::uint8_t, std::uint16_t, std::uint32_t, std::uint64_t,
+        float, double
+    >(builtins);
+
+    add_simd_builtins<
+        std::int8_t, std::int16_t, std::int32_t, std::int64_t,
+        std::uint8_t, std::uint16_t, std::uint32_t, std::uint64_t,
+        float, double, bool
+    >(builtins);
+
     return builtins;
 }
 
@@ -219,4 +414,55 @@ auto fetch_builtin(const std::string& name, const std::vector<type_name>& args)
     return it->second;
 }
 
+auto is_formattable(const type_name& type) -> bool
+{
+    if (std::holds_alternative<type_list>(type)) {
+        return inner_type(type) == char_type();
+    }
+    return std::holds_alternative<type_ptr>(type)
+        || is_simd_type(type)
+        || type == i8_type()
+        || type == i16_type()
+        || type == i32_type()
+        || type == i64_type()
+        || type == u8_type()
+        || type == u16_type()
+        || type == u32_type()
+        || type == u64_type()
+        || type == f32_type()
+        || type == f64_type()
+        || type == char_type()
+        || type == bool_type()
+        || type == null_type();
+}
+
+auto make_format_builtin(
+    const std::vector<std::string>& pieces,
+    const std::vector<type_name>& args,
+    const std::vector<std::size_t>& sizes,
+    bool newline
+) -> builtin_val
+{
+    const auto args_size = std::accumulate(sizes.begin(), sizes.end(), std::size_t{0});
+
+    return builtin_val{
+        .ptr = [=](std::vector<std::byte>& mem) -> void {
+            auto out = pieces.front();
+            auto ptr = mem.size() - args_size;
+            for (std::size_t i = 0; i != args.size(); ++i) {
+                out += format_value(mem.data() + ptr, args[i], sizes[i]);
+                out += pieces[i + 1];
+                ptr += sizes[i];
+            }
+            if (newline) {
+                out += '\n';
+            }
+            print("{}", out);
+            pop_n(mem, args_size);
+            mem.push_back(std::byte{0}); // Return null
+        },
+        .return_type = null_type()
+    };
+}
+
 }
\ No newline at end of file
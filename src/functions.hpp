@@ -2,12 +2,20 @@
 #include "object.hpp"
 
 #include <functional>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <span>
 
 namespace anzu {
 
+// Thrown when the program cannot continue, such as on a failed runtime check or a division by
+// zero. The runtime reports it and exits, and evaluation at compile time gives up on the call.
+struct runtime_error : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
 using builtin_function = std::function<void(std::vector<std::byte>&)>;
 
 struct builtin_key
@@ -37,5 +45,19 @@ using builtin_map = std::unordered_map<builtin_key, builtin_val, builtin_hash>;
 
 auto is_builtin(const std::string& name, const std::vector<type_name>& args) -> bool;
 auto fetch_builtin(const std::string& name, const std::vector<type_name>& args) -> builtin_val;
+
+// Returns true if values of the given type can be used as arguments to a format builtin.
+auto is_formattable(const type_name& type) -> bool;
+
+// Creates a builtin which formats all of its args into a single string and prints it in one
+// go. The pieces are the text surrounding each placeholder in the format string, so there is
+// always one more piece than there are args. The sizes of the args are given by the caller,
+// which knows the layout of each type.
+auto make_format_builtin(
+    const std::vector<std::string>& pieces,
+    const std::vector<type_name>& args,
+    const std::vector<std::size_t>& sizes,
+    bool newline
+) -> builtin_val;
     
 }
\ No newline at end of file
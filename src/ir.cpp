@@ -0,0 +1,526 @@
+#include "ir.hpp"
+#include "utility/print.hpp"
+#include "utility/overloaded.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <format>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace anzu {
+namespace {
+
+template <typename... Args>
+[[noreturn]] void ir_error(std::string_view msg, Args&&... args)
+{
+    throw lift_error{std::format(msg, std::forward<Args>(args)...)};
+}
+
+constexpr auto no_block = static_cast<std::size_t>(-1);
+
+// Returns the absolute position that the op jumps to, if it is a jump. Function definitions
+// jump over their body.
+auto jump_target(const op& code, std::size_t pos) -> std::optional<std::size_t>
+{
+    return std::visit(overloaded{
+        [&](const op_jump& op) -> std::optional<std::size_t> { return pos + op.jump; },
+        [&](const op_jump_if_false& op) -> std::optional<std::size_t> { return pos + op.jump; },
+        [&](const op_jump_if_true& op) -> std::optional<std::size_t> { return pos + op.jump; },
+        [&](const op_function& op) -> std::optional<std::size_t> { return op.jump; },
+        [&](const auto&) -> std::optional<std::size_t> { return std::nullopt; }
+    }, code);
+}
+
+// Returns true if control never continues to the next op
+auto is_terminator(const op& code) -> bool
+{
+    return std::holds_alternative<op_jump>(code)
+        || std::holds_alternative<op_function>(code)
+        || std::holds_alternative<op_return>(code)
+        || std::holds_alternative<op_tail_call>(code);
+}
+
+auto ends_block(const op& code) -> bool
+{
+    return is_terminator(code)
+        || std::holds_alternative<op_jump_if_false>(code)
+        || std::holds_alternative<op_jump_if_true>(code);
+}
+
+struct stack_effect
+{
+    std::size_t pops   = 0;
+    std::size_t pushes = 0;
+    std::size_t peeks  = 0; // Bytes read from the top of the stack without popping them
+};
+
+auto effect_of(const op& code) -> stack_effect
+{
+    constexpr auto ptr_size = sizeof(std::uint64_t);
+    return std::visit(overloaded{
+        [](const op_load_bytes& op) { return stack_effect{ .pushes=op.bytes.size() }; },
+        [](const op_load_rom& op) { return stack_effect{ .pushes=op.size }; },
+        [](const op_push_rom_addr&) { return stack_effect{ .pushes=ptr_size }; },
+        [](const op_repeat& op) { return stack_effect{ .pops=op.size, .pushes=op.size * op.count }; },
+        [](const op_soa_pack& op) {
+            return stack_effect{ .pops=op.object_size * op.count, .pushes=op.object_size * op.count };
+        },
+        [](const op_push_global_addr&) { return stack_effect{ .pushes=ptr_size }; },
+        [](const op_push_local_addr&) { return stack_effect{ .pushes=ptr_size }; },
+        [](const op_modify_ptr&) { return stack_effect{ .pops=2 * ptr_size, .pushes=ptr_size }; },
+        [](const op_index_addr&) { return stack_effect{ .pops=2 * ptr_size, .pushes=ptr_size }; },
+        [](const op_slice_index_addr&) { return stack_effect{ .pops=3 * ptr_size, .pushes=ptr_size }; },
+        [](const op_soa_slice_field_addr&) { return stack_effect{ .pops=3 * ptr_size, .pushes=ptr_size }; },
+        [](const op_subslice&) { return stack_effect{ .pops=4 * ptr_size, .pushes=2 * ptr_size }; },
+        [](const op_check_ptr&) { return stack_effect{ .peeks=ptr_size }; },
+        [](const op_load& op) { return stack_effect{ .pops=ptr_size, .pushes=op.size }; },
+        [](const op_save& op) { return stack_effect{ .pops=ptr_size + op.size }; },
+        [](const op_pop& op) { return stack_effect{ .pops=op.size }; },
+        [](const op_allocate& op) { return stack_effect{ .pops=ptr_size, .pushes=(op.as_slice ? 2 : 1) * ptr_size }; },
+        [](const op_deallocate&) { return stack_effect{ .pops=ptr_size }; },
+        [](const op_vec_push& op) { return stack_effect{ .pops=ptr_size + op.elem_size, .pushes=1 }; },
+        [](const op_vec_pop& op) { return stack_effect{ .pops=ptr_size, .pushes=op.elem_size }; },
+        [](const op_vec_index_addr&) { return stack_effect{ .pops=2 * ptr_size, .pushes=ptr_size }; },
+        [](const op_vec_reserve&) { return stack_effect{ .pops=2 * ptr_size, .pushes=1 }; },
+        [](const op_vec_append&) { return stack_effect{ .pops=3 * ptr_size, .pushes=1 }; },
+        [](const op_vec_drop&) { return stack_effect{ .pops=ptr_size }; },
+        [](const op_vec_copy&) { return stack_effect{ .pops=3 * ptr_size, .pushes=3 * ptr_size }; },
+        [](const op_map_file& op) { return stack_effect{ .pops=op.path_size, .pushes=2 * ptr_size }; },
+        [](const op_jump_if_false&) { return stack_effect{ .pops=1 }; },
+        [](const op_jump_if_true&) { return stack_effect{ .pops=1 }; },
+        [](const op_return& op) { return stack_effect{ .pops=op.local ? 0 : op.size }; },
+        [](const op_function_call& op) { return stack_effect{ .pops=op.args_size, .pushes=op.return_size }; },
+        [](const op_tail_call& op) { return stack_effect{ .pops=op.args_size }; },
+        [](const op_memo_store& op) { return stack_effect{ .peeks=op.result_size }; },
+        [](const op_builtin_call& op) { return stack_effect{ .pops=op.args_size, .pushes=op.return_size }; },
+        [](const op_reg_move& op) { return stack_effect{ .pushes=op.dst ? 0 : op.src.size }; },
+        [](const op_reg_call& op) { return stack_effect{ .pushes=op.dst ? 0 : op.return_size }; },
+        [](const auto&) { return stack_effect{}; }
+    }, code);
+}
+
+using abstract_stack = std::vector<ir_operand>;
+
+auto stack_depth(const abstract_stack& stack) -> std::size_t
+{
+    auto depth = std::size_t{0};
+    for (const auto& entry : stack) {
+        depth += entry.size;
+    }
+    return depth;
+}
+
+// Pushes the operand, merging it with the top of the stack if both are variable bytes
+auto push_entry(abstract_stack& stack, const ir_operand& entry) -> void
+{
+    if (!entry.value && !stack.empty() && !stack.back().value) {
+        stack.back().size += entry.size;
+    } else {
+        stack.push_back(entry);
+    }
+}
+
+// Removes the given number of bytes from the top of the stack and returns them in stack order
+auto pop_bytes(abstract_stack& stack, std::size_t size) -> std::vector<ir_operand>
+{
+    auto ret = std::vector<ir_operand>{};
+    while (size > 0) {
+        if (stack.empty()) {
+            ir_error("stack underflow while lifting");
+        }
+        auto& top = stack.back();
+        if (top.size <= size) {
+            size -= top.size;
+            ret.push_back(top);
+            stack.pop_back();
+        } else {
+            ret.push_back({ .value=top.value, .offset=top.offset + top.size - size, .size=size });
+            top.size -= size;
+            size = 0;
+        }
+    }
+    std::ranges::reverse(ret);
+    return ret;
+}
+
+struct lift_context
+{
+    ir_function&                                    func;
+    bool                                            is_top_level;
+    std::unordered_map<std::size_t, const op*>      producers;
+};
+
+auto new_value(lift_context& ctx, std::size_t size) -> std::size_t
+{
+    ctx.func.value_sizes.push_back(size);
+    return ctx.func.value_sizes.size() - 1;
+}
+
+// A save of a value to the stack position where the value already is is how variables are
+// declared. The value then stays on the stack as the storage of the variable.
+auto is_declaration(
+    const lift_context& ctx, const std::vector<ir_operand>& addr, std::size_t position
+)
+    -> bool
+{
+    if (addr.size() != 1 || !addr.front().value) {
+        return false;
+    }
+    const auto it = ctx.producers.find(*addr.front().value);
+    if (it == ctx.producers.end()) {
+        return false;
+    }
+    if (ctx.is_top_level) {
+        const auto push = std::get_if<op_push_global_addr>(it->second);
+        return push && push->position == position;
+    }
+    const auto push = std::get_if<op_push_local_addr>(it->second);
+    return push && push->offset == position;
+}
+
+auto register_destination(const op& code) -> std::optional<reg_operand>
+{
+    if (const auto move = std::get_if<op_reg_move>(&code)) return move->dst;
+    if (const auto call = std::get_if<op_reg_call>(&code)) return call->dst;
+    return std::nullopt;
+}
+
+auto simulate(lift_context& ctx, ir_instruction& inst, abstract_stack& stack) -> void
+{
+    // Register ops declare a variable by storing to the top of the stack
+    if (const auto dst = register_destination(inst.code)) {
+        const auto is_local = dst->src == reg_operand::source::local;
+        if (is_local != ctx.is_top_level && dst->offset == stack_depth(stack)) {
+            push_entry(stack, { .value=std::nullopt, .offset=0, .size=dst->size });
+        }
+        return;
+    }
+
+    if (const auto save = std::get_if<op_save>(&inst.code)) {
+        const auto addr = pop_bytes(stack, sizeof(std::uint64_t));
+        const auto is_decl = stack_depth(stack) >= save->size
+                          && is_declaration(ctx, addr, stack_depth(stack) - save->size);
+        inst.args = pop_bytes(stack, save->size);
+        inst.args.insert(inst.args.end(), addr.begin(), addr.end());
+        if (is_decl) {
+            push_entry(stack, { .value=std::nullopt, .offset=0, .size=save->size });
+        }
+        return;
+    }
+
+    const auto effect = effect_of(inst.code);
+    if (effect.peeks > 0) {
+        inst.args = pop_bytes(stack, effect.peeks);
+        for (const auto& arg : inst.args) {
+            push_entry(stack, arg);
+        }
+    } else {
+        inst.args = pop_bytes(stack, effect.pops);
+    }
+
+    if (effect.pushes > 0) {
+        const auto id = new_value(ctx, effect.pushes);
+        inst.result = id;
+        ctx.producers[id] = &inst.code;
+        push_entry(stack, { .value=id, .offset=0, .size=effect.pushes });
+    }
+}
+
+auto lift_function(
+    const program& prog,
+    ir_function& func,
+    const std::vector<std::size_t>& positions,
+    bool is_top_level
+)
+    -> void
+{
+    if (positions.empty()) {
+        return;
+    }
+
+    // Find the positions that start a new block
+    auto leaders = std::unordered_set<std::size_t>{positions.front()};
+    for (std::size_t i = 0; i != positions.size(); ++i) {
+        const auto& code = prog.code[positions[i]];
+        if (const auto target = jump_target(code, positions[i])) {
+            leaders.insert(*target);
+        }
+        if (ends_block(code) && i + 1 < positions.size()) {
+            leaders.insert(positions[i + 1]);
+        }
+    }
+
+    auto block_of = std::unordered_map<std::size_t, std::size_t>{};
+    for (const auto pos : positions) {
+        if (leaders.contains(pos)) {
+            func.blocks.emplace_back();
+            block_of[pos] = func.blocks.size() - 1;
+        }
+        func.blocks.back().instructions.push_back({ .position=pos, .code=prog.code[pos] });
+    }
+
+    const auto find_block = [&](std::size_t pos) {
+        const auto it = block_of.find(pos);
+        return it != block_of.end() ? it->second : no_block;
+    };
+
+    // Link the blocks, jumps to the end of the function or program have no successor
+    for (std::size_t b = 0; b != func.blocks.size(); ++b) {
+        auto& block = func.blocks[b];
+        const auto& last = block.instructions.back();
+        if (const auto target = jump_target(last.code, last.position)) {
+            if (const auto succ = find_block(*target); succ != no_block) {
+                block.successors.push_back({ .block=succ });
+            }
+        }
+        if (!is_terminator(last.code) && b + 1 < func.blocks.size()) {
+            block.successors.push_back({ .block=b + 1 });
+        }
+    }
+
+    // Simulate the stack through each block reachable from the entry
+    auto ctx = lift_context{ .func=func, .is_top_level=is_top_level };
+    auto entries = std::vector<std::optional<abstract_stack>>(func.blocks.size());
+    entries[0].emplace();
+    if (func.args_size > 0) {
+        push_entry(*entries[0], { .value=std::nullopt, .offset=0, .size=func.args_size });
+    }
+    func.blocks[0].reachable = true;
+
+    auto worklist = std::deque<std::size_t>{0};
+    while (!worklist.empty()) {
+        const auto b = worklist.front();
+        worklist.pop_front();
+
+        auto stack = *entries[b];
+        for (auto& inst : func.blocks[b].instructions) {
+            simulate(ctx, inst, stack);
+        }
+
+        for (auto& edge : func.blocks[b].successors) {
+            for (const auto& entry : stack) {
+                if (entry.value) edge.args.push_back(entry);
+            }
+
+            auto& succ = func.blocks[edge.block];
+            if (!entries[edge.block]) {
+                auto entry_stack = abstract_stack{};
+                for (const auto& entry : stack) {
+                    if (entry.value) {
+                        const auto id = new_value(ctx, entry.size);
+                        succ.params.push_back(id);
+                        push_entry(entry_stack, { .value=id, .offset=0, .size=entry.size });
+                    } else {
+                        push_entry(entry_stack, entry);
+                    }
+                }
+                entries[edge.block] = std::move(entry_stack);
+                succ.reachable = true;
+                worklist.push_back(edge.block);
+            }
+            else if (stack_depth(*entries[edge.block]) != stack_depth(stack)) {
+                ir_error("mismatched stack sizes entering block {} of '{}'", edge.block, func.name);
+            }
+        }
+    }
+}
+
+auto format_operand(const ir_operand& operand, const ir_function& func) -> std::string
+{
+    if (!operand.value) {
+        return std::format("vars({})", operand.size);
+    }
+    if (operand.offset == 0 && operand.size == func.value_sizes[*operand.value]) {
+        return std::format("%{}", *operand.value);
+    }
+    return std::format("%{}[{}:{}]", *operand.value, operand.offset, operand.offset + operand.size);
+}
+
+auto format_operands(const std::vector<ir_operand>& operands, const ir_function& func) -> std::string
+{
+    auto ret = std::string{};
+    for (const auto& operand : operands) {
+        if (!ret.empty()) ret += ", ";
+        ret += format_operand(operand, func);
+    }
+    return ret;
+}
+
+auto set_relative_jump(op& code, std::int64_t jump) -> void
+{
+    std::visit(overloaded{
+        [&](op_jump& op) { op.jump = jump; },
+        [&](op_jump_if_false& op) { op.jump = static_cast<std::size_t>(jump); },
+        [&](op_jump_if_true& op) { op.jump = jump; },
+        [&](auto&) {}
+    }, code);
+}
+
+}
+
+auto lift(const program& prog) -> ir_program
+{
+    auto ir = ir_program{
+        .rom=prog.rom,
+        .size=prog.code.size(),
+        .frame_alignment=prog.frame_alignment,
+        .track_allocations=prog.track_allocations
+    };
+    ir.functions.push_back({ .name="<top level>", .begin=0, .args_size=0 });
+
+    // Function bodies are separate functions in the IR, everything else is top level code
+    auto owner = std::vector<std::size_t>(prog.code.size(), 0);
+    for (std::size_t pos = 0; pos != prog.code.size(); ++pos) {
+        if (const auto func = std::get_if<op_function>(&prog.code[pos])) {
+            ir.functions.push_back({ .name=func->name, .begin=pos, .args_size=func->args_size });
+            for (auto body = pos + 1; body != func->jump; ++body) {
+                owner[body] = ir.functions.size() - 1;
+            }
+        }
+    }
+
+    auto positions = std::vector<std::vector<std::size_t>>(ir.functions.size());
+    for (std::size_t pos = 0; pos != prog.code.size(); ++pos) {
+        positions[owner[pos]].push_back(pos);
+    }
+    for (std::size_t i = 0; i != ir.functions.size(); ++i) {
+        lift_function(prog, ir.functions[i], positions[i], i == 0);
+    }
+    return ir;
+}
+
+auto lower(const ir_program& ir) -> program
+{
+    auto instructions = std::vector<const ir_instruction*>{};
+    for (const auto& func : ir.functions) {
+        for (const auto& block : func.blocks) {
+            for (const auto& inst : block.instructions) {
+                instructions.push_back(&inst);
+            }
+        }
+    }
+    std::ranges::sort(instructions, {}, &ir_instruction::position);
+
+    // The new position of each op, or of the next remaining op if it was removed
+    auto kept = std::vector<bool>(ir.size, false);
+    for (const auto inst : instructions) {
+        kept[inst->position] = true;
+    }
+    auto new_pos = std::vector<std::size_t>(ir.size + 1, 0);
+    for (std::size_t pos = 0, count = 0; pos != ir.size + 1; ++pos) {
+        new_pos[pos] = count;
+        if (pos < ir.size && kept[pos]) ++count;
+    }
+
+    auto prog = program{ .rom=ir.rom, .frame_alignment=ir.frame_alignment, .track_allocations=ir.track_allocations };
+    for (const auto inst : instructions) {
+        auto code = inst->code;
+        std::visit(overloaded{
+            [&](op_function& op) { op.jump = new_pos[op.jump]; },
+            [&](op_function_call& op) { op.ptr = new_pos[op.ptr]; },
+            [&](op_tail_call& op) { op.ptr = new_pos[op.ptr]; },
+            [&](auto&) {
+                if (const auto target = jump_target(code, inst->position)) {
+                    const auto from = static_cast<std::int64_t>(new_pos[inst->position]);
+                    set_relative_jump(code, static_cast<std::int64_t>(new_pos[*target]) - from);
+                }
+            }
+        }, code);
+        prog.code.push_back(std::move(code));
+    }
+    return prog;
+}
+
+auto eliminate_dead_code(ir_program& ir) -> std::size_t
+{
+    auto function_at = std::unordered_map<std::size_t, std::size_t>{};
+    for (std::size_t i = 1; i < ir.functions.size(); ++i) {
+        function_at[ir.functions[i].begin] = i;
+    }
+
+    // Find the functions called from reachable code, starting from the top level
+    auto live = std::vector<bool>(ir.functions.size(), false);
+    live[0] = true;
+    auto worklist = std::vector<std::size_t>{0};
+    while (!worklist.empty()) {
+        const auto f = worklist.back();
+        worklist.pop_back();
+        for (const auto& block : ir.functions[f].blocks) {
+            if (!block.reachable) continue;
+            for (const auto& inst : block.instructions) {
+                auto ptr = std::optional<std::size_t>{};
+                if (const auto call = std::get_if<op_function_call>(&inst.code)) ptr = call->ptr;
+                if (const auto call = std::get_if<op_tail_call>(&inst.code)) ptr = call->ptr;
+                if (!ptr) continue;
+
+                const auto it = function_at.find(*ptr - 1);
+                if (it != function_at.end() && !live[it->second]) {
+                    live[it->second] = true;
+                    worklist.push_back(it->second);
+                }
+            }
+        }
+    }
+
+    auto removed = std::size_t{0};
+    for (std::size_t f = 0; f != ir.functions.size(); ++f) {
+        for (auto& block : ir.functions[f].blocks) {
+            if (!live[f] || !block.reachable) {
+                removed += block.instructions.size();
+                block.instructions.clear();
+                block.successors.clear();
+                block.reachable = false;
+            }
+        }
+    }
+
+    // The definitions of dead functions jump over their body, which is now gone
+    for (auto& block : ir.functions.front().blocks) {
+        removed += std::erase_if(block.instructions, [&](const ir_instruction& inst) {
+            return std::holds_alternative<op_function>(inst.code)
+                && !live[function_at.at(inst.position)];
+        });
+    }
+    return removed;
+}
+
+auto print_ir(const ir_program& ir) -> void
+{
+    for (const auto& func : ir.functions) {
+        if (&func == &ir.functions.front()) {
+            print("function {}\n", func.name);
+        } else {
+            print("\nfunction {} (args: {} bytes)\n", func.name, func.args_size);
+        }
+
+        for (std::size_t b = 0; b != func.blocks.size(); ++b) {
+            const auto& block = func.blocks[b];
+            if (block.instructions.empty()) continue;
+
+            auto params = std::string{};
+            for (const auto param : block.params) {
+                params += std::format("{}%{}", params.empty() ? "" : ", ", param);
+            }
+            print("  block {}{}{}:\n", b,
+                params.empty() ? "" : std::format(" [{}]", params),
+                block.reachable ? "" : " (unreachable)"
+            );
+
+            for (const auto& inst : block.instructions) {
+                const auto result = inst.result ? std::format("%{} = ", *inst.result) : std::string{};
+                const auto args = format_operands(inst.args, func);
+                print("    {:>4} - {}{}{}\n", inst.position, result, to_string(inst.code), args.empty() ? "" : " " + args);
+            }
+
+            for (const auto& edge : block.successors) {
+                const auto args = format_operands(edge.args, func);
+                print("    -> block {}{}\n", edge.block, args.empty() ? "" : std::format(" [{}]", args));
+            }
+        }
+    }
+}
+
+}
\ No newline at end of file
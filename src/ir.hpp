@@ -0,0 +1,91 @@
+#pragma once
+#include "program.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace anzu {
+
+// An intermediate representation lifted from a compiled program. Each function is split into
+// basic blocks, and the values passed between ops on the stack are given SSA names by
+// simulating the stack. Values only have a size, since the ops do not carry types. Stack bytes
+// that hold variables are not SSA values since they are modified in place, they are accessed
+// through pointers with LOAD and SAVE.
+//
+// The IR only sees sizes and stack slots, so it is used for the passes that need control flow
+// but no types, currently dead code elimination. Passes that reason about variables and types,
+// such as hoisting loop invariants, removing bounds checks and reusing stack slots, are done by
+// the compiler on the AST.
+
+// The bytes of an SSA value used by an op. Ops consume sized ranges of the stack which do not
+// always line up with the values that were pushed, so an operand may be part of a value. An
+// operand without a value refers to the stack bytes of variables.
+struct ir_operand
+{
+    std::optional<std::size_t> value;
+    std::size_t                offset;
+    std::size_t                size;
+};
+
+struct ir_instruction
+{
+    std::size_t                position; // The position of the op in the lifted program
+    op                         code;
+    std::vector<ir_operand>    args;
+    std::optional<std::size_t> result;
+};
+
+// Values still on the stack at the end of a block are passed to the params of its successors,
+// which takes the place of phi nodes.
+struct ir_edge
+{
+    std::size_t             block;
+    std::vector<ir_operand> args;
+};
+
+struct ir_block
+{
+    std::vector<std::size_t>    params;
+    std::vector<ir_instruction> instructions;
+    std::vector<ir_edge>        successors;
+    bool                        reachable = false;
+};
+
+struct ir_function
+{
+    std::string              name;
+    std::size_t              begin;     // The position of the op_function, 0 for the top level
+    std::size_t              args_size;
+    std::vector<ir_block>    blocks;    // The first block is the entry
+    std::vector<std::size_t> value_sizes;
+};
+
+struct ir_program
+{
+    std::vector<ir_function> functions; // The first function is the top level code
+    std::vector<std::byte>   rom;
+    std::size_t              size;      // The number of ops in the lifted program
+    std::size_t              frame_alignment;
+    bool                     track_allocations;
+};
+
+// Thrown when a program cannot be lifted, such as when the paths into a block leave different
+// amounts on the stack. The program can still be run as compiled, without the IR passes.
+struct lift_error : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+auto lift(const program& prog) -> ir_program;
+auto lower(const ir_program& ir) -> program;
+
+// Removes the blocks that cannot be reached and the functions that are never called from
+// reachable code. Returns the number of ops removed.
+auto eliminate_dead_code(ir_program& ir) -> std::size_t;
+
+auto print_ir(const ir_program& ir) -> void;
+
+}
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include <fstream>
 #include <sstream>
 #include <optional>
+#include <array>
+#include <utility>
 
 namespace anzu {
 namespace {
@@ -20,12 +22,23 @@ auto is_int(std::string_view token) -> bool
     return !token.empty() && std::ranges::all_of(token, [](char c) { return std::isdigit(c); });
 }
 
-auto is_i32(std::string_view token) -> bool
+// Integer literals of types other than i64 and u64 must end with the name of the type
+auto suffixed_int_type(std::string_view token) -> std::optional<token_type>
 {
-    const auto has_suffix = token.ends_with(tk_i32);
-    if (!has_suffix) { return false; }
-    token.remove_suffix(tk_i32.size());
-    return is_int(token);
+    static constexpr auto suffixes = std::array{
+        std::pair{tk_i8, token_type::i8},
+        std::pair{tk_i16, token_type::i16},
+        std::pair{tk_i32, token_type::i32},
+        std::pair{tk_u8, token_type::u8},
+        std::pair{tk_u16, token_type::u16},
+        std::pair{tk_u32, token_type::u32}
+    };
+    for (const auto& [suffix, type] : suffixes) {
+        if (token.ends_with(suffix) && is_int(token.substr(0, token.size() - suffix.size()))) {
+            return type;
+        }
+    }
+    return std::nullopt;
 }
 
 auto is_i64(std::string_view token) -> bool
@@ -46,6 +59,16 @@ auto is_u64(std::string_view token) -> bool
     return is_int(token);
 }
 
+auto is_f32(std::string_view token) -> bool
+{
+    const auto has_suffix = token.ends_with(tk_f32);
+    if (!has_suffix) { return false; }
+    token.remove_suffix(tk_f32.size());
+    return !token.empty()
+        && std::ranges::all_of(token, [](char c) { return std::isdigit(c) || c == '.'; })
+        && (std::ranges::count(token, '.') <= 1);
+}
+
 auto is_f64(std::string_view token) -> bool
 {
     if (token.ends_with(tk_f64)) {
@@ -175,8 +198,8 @@ auto lex_line(
                 if (is_keyword(token)) {
                     push_token(token, col, token_type::keyword);
                 }
-                else if (is_i32(token)) {
-                    push_token(token, col, token_type::i32);
+                else if (const auto type = suffixed_int_type(token); type.has_value()) {
+                    push_token(token, col, *type);
                 }
                 else if (is_i64(token)) {
                     push_token(token, col, token_type::i64);
@@ -184,6 +207,9 @@ auto lex_line(
                 else if (is_u64(token)) {
                     push_token(token, col, token_type::u64);
                 }
+                else if (is_f32(token)) {
+                    push_token(token, col, token_type::f32);
+                }
                 else if (is_f64(token)) {
                     push_token(token, col, token_type::f64);
                 }
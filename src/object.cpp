@@ -2,20 +2,61 @@
 #include "vocabulary.hpp"
 #include "utility/print.hpp"
 #include "utility/overloaded.hpp"
+#include "utility/memory.hpp"
 
 #include <algorithm>
+#include <optional>
 #include <ranges>
 #include <string_view>
+#include <utility>
 
 namespace anzu {
 namespace {
 
+// SIMD types are aligned to their size up to this, which is the largest alignment of any type
+constexpr auto max_alignment = std::size_t{16};
+
 auto format_error(const std::string& str) -> void
 {
     anzu::print("format error: could not format special chars in '{}'\n", str);
     std::exit(1);
 }
 
+auto is_simd_lane_type(const type_name& type) -> bool
+{
+    return type == i8_type()
+        || type == i16_type()
+        || type == i32_type()
+        || type == i64_type()
+        || type == u8_type()
+        || type == u16_type()
+        || type == u32_type()
+        || type == u64_type()
+        || type == f32_type()
+        || type == f64_type()
+        || type == bool_type();
+}
+
+// Splits the name of a vector type into the lane type and the number of lanes
+auto split_simd_type(const type_name& type) -> std::optional<std::pair<type_name, std::size_t>>
+{
+    const auto simple = std::get_if<type_simple>(&type);
+    if (!simple) return std::nullopt;
+
+    const auto pos = simple->name.rfind('x');
+    if (pos == std::string::npos) return std::nullopt;
+
+    const auto lane_type = make_type(simple->name.substr(0, pos));
+    const auto lanes = std::string_view{simple->name}.substr(pos + 1);
+    if (!is_simd_lane_type(lane_type)) return std::nullopt;
+    for (const auto count : {2, 4, 8, 16}) {
+        if (lanes == std::to_string(count)) {
+            return std::pair{lane_type, static_cast<std::size_t>(count)};
+        }
+    }
+    return std::nullopt;
+}
+
 }
 
 auto to_string(const object& object) -> std::string
@@ -43,6 +84,16 @@ auto to_string(const type_ptr& type) -> std::string
     return std::format("&{}", to_string(*type.inner_type));
 }
 
+auto to_string(const type_slice& type) -> std::string
+{
+    return std::format("&[{}]", to_string(*type.inner_type));
+}
+
+auto to_string(const type_vec& type) -> std::string
+{
+    return std::format("vec<{}>", to_string(*type.inner_type));
+}
+
 auto hash(const type_name& type) -> std::size_t
 {
     return std::visit([](const auto& t) { return hash(t); }, type);
@@ -64,6 +115,28 @@ auto hash(const type_ptr& type) -> std::size_t
     return hash(*type.inner_type) ^ ptr_offset;
 }
 
+auto hash(const type_slice& type) -> std::size_t
+{
+    static const auto slice_offset = std::hash<std::string_view>{}("slice_offset");
+    return hash(*type.inner_type) ^ slice_offset;
+}
+
+auto hash(const type_vec& type) -> std::size_t
+{
+    static const auto vec_offset = std::hash<std::string_view>{}("vec_offset");
+    return hash(*type.inner_type) ^ vec_offset;
+}
+
+auto i8_type() -> type_name
+{
+    return {type_simple{ .name = std::string{tk_i8} }};
+}
+
+auto i16_type() -> type_name
+{
+    return {type_simple{ .name = std::string{tk_i16} }};
+}
+
 auto i32_type() -> type_name
 {
     return {type_simple{ .name = std::string{tk_i32} }};
@@ -74,6 +147,21 @@ auto i64_type() -> type_name
     return {type_simple{ .name = std::string{tk_i64} }};
 }
 
+auto u8_type() -> type_name
+{
+    return {type_simple{ .name = std::string{tk_u8} }};
+}
+
+auto u16_type() -> type_name
+{
+    return {type_simple{ .name = std::string{tk_u16} }};
+}
+
+auto u32_type() -> type_name
+{
+    return {type_simple{ .name = std::string{tk_u32} }};
+}
+
 auto u64_type() -> type_name
 {
     return {type_simple{ .name = std::string{tk_u64} }};
@@ -84,6 +172,11 @@ auto char_type() -> type_name
     return {type_simple{ .name = std::string{tk_char} }};
 }
 
+auto f32_type() -> type_name
+{
+    return {type_simple{ .name = std::string{tk_f32} }};
+}
+
 auto f64_type() -> type_name
 {
     return {type_simple{ .name = std::string{tk_f64} }};
@@ -99,6 +192,11 @@ auto null_type() -> type_name
     return {type_simple{ .name = std::string{tk_null} }};
 }
 
+auto file_view_type() -> type_name
+{
+    return {type_simple{ .name = "#file_view" }};
+}
+
 auto make_type(const std::string& name) -> type_name
 {
     return { type_simple{ .name=name } };
@@ -124,6 +222,41 @@ auto is_ptr_type(const type_name& t) -> bool
     return std::holds_alternative<type_ptr>(t);
 }
 
+auto concrete_slice_type(const type_name& t) -> type_name
+{
+    return {type_slice{ .inner_type = { t } }};
+}
+
+auto is_slice_type(const type_name& t) -> bool
+{
+    return std::holds_alternative<type_slice>(t);
+}
+
+auto concrete_vec_type(const type_name& t) -> type_name
+{
+    return {type_vec{ .inner_type = { t } }};
+}
+
+auto is_vec_type(const type_name& t) -> bool
+{
+    return std::holds_alternative<type_vec>(t);
+}
+
+auto simd_type(const type_name& t, std::size_t lanes) -> type_name
+{
+    return make_type(std::format("{}x{}", t, lanes));
+}
+
+auto is_simd_type(const type_name& t) -> bool
+{
+    return split_simd_type(t).has_value();
+}
+
+auto simd_lanes(const type_name& t) -> std::size_t
+{
+    return split_simd_type(t)->second;
+}
+
 auto inner_type(const type_name& t) -> type_name
 {
     if (is_list_type(t)) {
@@ -132,6 +265,15 @@ auto inner_type(const type_name& t) -> type_name
     if (is_ptr_type(t)) {
         return *std::get<type_ptr>(t).inner_type;
     }
+    if (is_slice_type(t)) {
+        return *std::get<type_slice>(t).inner_type;
+    }
+    if (is_vec_type(t)) {
+        return *std::get<type_vec>(t).inner_type;
+    }
+    if (const auto simd = split_simd_type(t)) {
+        return simd->first;
+    }
     print("OH NO MY TYPE\n");
     std::exit(1);
     return {};
@@ -139,9 +281,15 @@ auto inner_type(const type_name& t) -> type_name
 
 auto is_type_fundamental(const type_name& type) -> bool
 {
-    return type == i32_type()
+    return type == i8_type()
+        || type == i16_type()
+        || type == i32_type()
         || type == i64_type()
+        || type == u8_type()
+        || type == u16_type()
+        || type == u32_type()
         || type == u64_type()
+        || type == f32_type()
         || type == f64_type()
         || type == char_type()
         || type == bool_type()
@@ -173,21 +321,32 @@ auto to_string(const signature& sig) -> std::string
     return std::format("({}) -> {}", format_comma_separated(sig.params, proj), sig.return_type);
 }
 
-auto type_store::add(const type_name& name, const type_fields& fields) -> bool
+auto type_store::add(const type_name& name, const type_fields& fields, bool soa) -> bool
 {
     if (d_classes.contains(name)) {
         return false;
     }
     d_classes.emplace(name, fields);
+    if (soa) {
+        d_soa_classes.emplace(name);
+    }
     return true;
 }
 
+auto type_store::is_soa(const type_name& type) const -> bool
+{
+    return d_soa_classes.contains(type);
+}
+
 auto type_store::contains(const type_name& type) const -> bool
 {
     return d_classes.contains(type)
         || is_type_fundamental(type)
         || is_list_type(type)
-        || is_ptr_type(type);
+        || is_ptr_type(type)
+        || is_slice_type(type)
+        || is_vec_type(type)
+        || is_simd_type(type);
 }
 
 auto type_store::size_of(const type_name& type) const -> std::size_t
@@ -201,7 +360,11 @@ auto type_store::size_of(const type_name& type) const -> std::size_t
         return 8; // Two unsigned ints, ptr and size
     }
 
-    if (type == i32_type()) {
+    if (type == i16_type() || type == u16_type()) {
+        return 2;
+    }
+
+    if (type == i32_type() || type == u32_type() || type == f32_type()) {
         return 4;
     }
 
@@ -212,29 +375,104 @@ auto type_store::size_of(const type_name& type) const -> std::size_t
     if (is_type_fundamental(type)) {
         return 1;
     }
+
+    if (is_simd_type(type)) {
+        return size_of(inner_type(type)) * simd_lanes(type);
+    }
     
     return std::visit(overloaded{
         [&](const type_simple& t) {
             auto size = std::size_t{0};
             for (const auto& field : fields_of(type)) {
-                size += size_of(field.type);
+                size = align_up(size, align_of(field.type)) + size_of(field.type);
             }
-            return size;
+            return align_up(size, align_of(type));
         },
         [&](const type_list& t) {
             return size_of(*t.inner_type) * t.count;
         },
         [](const type_ptr&) {
             return std::size_t{1};
+        },
+        [&](const type_slice&) {
+            return size_of(u64_type()) * 2;
+        },
+        [&](const type_vec&) {
+            return size_of(u64_type()) * 3;
         }
     }, type);
 }
 
+auto type_store::max_align() const -> std::size_t
+{
+    return d_aligned ? max_alignment : 1;
+}
+
+auto type_store::align_of(const type_name& type) const -> std::size_t
+{
+    if (!d_aligned) {
+        return 1;
+    }
+
+    return std::visit(overloaded{
+        [&](const type_simple&) {
+            if (is_type_fundamental(type)) {
+                return size_of(type);
+            }
+            if (is_simd_type(type)) {
+                return std::min(size_of(type), max_alignment);
+            }
+            auto align = std::size_t{1};
+            for (const auto& field : fields_of(type)) {
+                align = std::max(align, align_of(field.type));
+            }
+            return align;
+        },
+        [&](const type_list& t) {
+            return align_of(*t.inner_type);
+        },
+        [](const type_ptr&) {
+            return sizeof(std::uint64_t);
+        },
+        [](const type_slice&) {
+            return sizeof(std::uint64_t);
+        },
+        [](const type_vec&) {
+            return sizeof(std::uint64_t);
+        }
+    }, type);
+}
+
+auto type_store::offsets_of(const type_name& type) const -> std::vector<std::size_t>
+{
+    auto offsets = std::vector<std::size_t>{};
+    auto offset = std::size_t{0};
+    for (const auto& field : fields_of(type)) {
+        offset = align_up(offset, align_of(field.type));
+        offsets.push_back(offset);
+        offset += size_of(field.type);
+    }
+    return offsets;
+}
+
 auto type_store::fields_of(const type_name& t) const -> type_fields
 {
     if (auto it = d_classes.find(t); it != d_classes.end()) {
         return it->second;
     }
+    if (is_slice_type(t)) {
+        return {
+            { .name="data", .type=concrete_ptr_type(inner_type(t)) },
+            { .name="size", .type=u64_type() }
+        };
+    }
+    if (is_vec_type(t)) {
+        return {
+            { .name="data", .type=concrete_ptr_type(inner_type(t)) },
+            { .name="size", .type=u64_type() },
+            { .name="capacity", .type=u64_type() }
+        };
+    }
     return {};
 }
 
@@ -4,6 +4,7 @@
 #include <string>
 #include <variant>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "utility/print.hpp"
@@ -36,10 +37,28 @@ struct type_ptr
     auto operator==(const type_ptr&) const -> bool = default;
 };
 
+// A view of a number of contiguous elements stored elsewhere, made up of a pointer to the
+// first element and the number of elements.
+struct type_slice
+{
+    value_ptr<type_name> inner_type;
+    auto operator==(const type_slice&) const -> bool = default;
+};
+
+// A growable array of elements on the heap, made up of a pointer to the elements, the number
+// of elements and the number there is space for. The operations on it are implemented natively.
+struct type_vec
+{
+    value_ptr<type_name> inner_type;
+    auto operator==(const type_vec&) const -> bool = default;
+};
+
 struct type_name : public std::variant<
     type_simple,
     type_list,
-    type_ptr>
+    type_ptr,
+    type_slice,
+    type_vec>
 {
     using variant::variant;
 };
@@ -68,16 +87,60 @@ using type_fields = std::vector<field>;
 auto hash(const type_name& type) -> std::size_t;
 auto hash(const type_list& type) -> std::size_t;
 auto hash(const type_ptr& type) -> std::size_t;
+auto hash(const type_slice& type) -> std::size_t;
+auto hash(const type_vec& type) -> std::size_t;
 auto hash(const type_simple& type) -> std::size_t;
 
+auto i8_type() -> type_name;
+auto i16_type() -> type_name;
 auto i32_type() -> type_name;
 auto i64_type() -> type_name;
+auto u8_type() -> type_name;
+auto u16_type() -> type_name;
+auto u32_type() -> type_name;
 auto u64_type() -> type_name;
+auto f32_type() -> type_name;
 auto f64_type() -> type_name;
 auto char_type() -> type_name;
 auto bool_type() -> type_name;
 auto null_type() -> type_name;
 
+// The anzu type of the given fundamental C++ type
+template <typename T>
+auto to_type_name() -> type_name
+{
+    if constexpr (std::is_same_v<T, std::int8_t>) {
+        return i8_type();
+    } else if constexpr (std::is_same_v<T, std::int16_t>) {
+        return i16_type();
+    } else if constexpr (std::is_same_v<T, std::int32_t>) {
+        return i32_type();
+    } else if constexpr (std::is_same_v<T, std::int64_t>) {
+        return i64_type();
+    } else if constexpr (std::is_same_v<T, std::uint8_t>) {
+        return u8_type();
+    } else if constexpr (std::is_same_v<T, std::uint16_t>) {
+        return u16_type();
+    } else if constexpr (std::is_same_v<T, std::uint32_t>) {
+        return u32_type();
+    } else if constexpr (std::is_same_v<T, std::uint64_t>) {
+        return u64_type();
+    } else if constexpr (std::is_same_v<T, float>) {
+        return f32_type();
+    } else if constexpr (std::is_same_v<T, double>) {
+        return f64_type();
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return bool_type();
+    } else {
+        static_assert(false);
+    }
+}
+
+// The builtin struct returned by read_file and embed, containing a pointer to the data and
+// its size. Its name starts with '#', which cannot appear in a name in the source, so it cannot
+// clash with a user struct.
+auto file_view_type() -> type_name;
+
 auto make_type(const std::string& name) -> type_name;
 
 auto concrete_list_type(const type_name& t, std::size_t size) -> type_name;
@@ -86,6 +149,18 @@ auto is_list_type(const type_name& t) -> bool;
 auto concrete_ptr_type(const type_name& t) -> type_name;
 auto is_ptr_type(const type_name& t) -> bool;
 
+auto concrete_slice_type(const type_name& t) -> type_name;
+auto is_slice_type(const type_name& t) -> bool;
+
+auto concrete_vec_type(const type_name& t) -> type_name;
+auto is_vec_type(const type_name& t) -> bool;
+
+// Small vectors of numbers that arithmetic applies to lane by lane, named by the type of the
+// lanes and the number of them, such as f64x4. Comparing them gives a vector of bools, a mask.
+auto simd_type(const type_name& t, std::size_t lanes) -> type_name;
+auto is_simd_type(const type_name& t) -> bool;
+auto simd_lanes(const type_name& t) -> std::size_t;
+
 // Extracts the single inner type of the given t. Undefined if the given t is not a compound
 // type with a single subtype.
 auto inner_type(const type_name& t) -> type_name;
@@ -108,19 +183,37 @@ class type_store
 {
     using type_hash = decltype([](const type_name& t) { return anzu::hash(t); });
     std::unordered_map<type_name, type_fields, type_hash> d_classes;
+    std::unordered_set<type_name, type_hash>              d_soa_classes;
+
+    // If set, values are given their natural alignment within structs, otherwise fields are
+    // packed with no padding
+    bool d_aligned = false;
 
 public:
-    auto add(const type_name& name, const type_fields& fields) -> bool;
+    type_store() = default;
+    explicit type_store(bool aligned) : d_aligned{aligned} {}
+
+    auto add(const type_name& name, const type_fields& fields, bool soa = false) -> bool;
     auto contains(const type_name& t) const -> bool;
 
+    // Lists of soa types are stored column-wise: the values of each field are contiguous
+    auto is_soa(const type_name& t) const -> bool;
+
     auto size_of(const type_name& t) const -> std::size_t;
+    auto align_of(const type_name& t) const -> std::size_t;
+    auto max_align() const -> std::size_t; // No type needs a greater alignment than this
     auto fields_of(const type_name& t) const -> type_fields;
+
+    // The offset of each field within the given type, in the order they are declared
+    auto offsets_of(const type_name& t) const -> std::vector<std::size_t>;
 };
 
 auto to_string(const object& object) -> std::string;
 auto to_string(const type_name& type) -> std::string;
 auto to_string(const type_list& type) -> std::string;
 auto to_string(const type_ptr& type) -> std::string;
+auto to_string(const type_slice& type) -> std::string;
+auto to_string(const type_vec& type) -> std::string;
 auto to_string(const type_simple& type) -> std::string;
 auto to_string(const signature& sig) -> std::string;
 
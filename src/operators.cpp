@@ -4,27 +4,14 @@
 #include "utility/memory.hpp"
 
 #include <algorithm>
+#include <array>
 #include <functional>
+#include <limits>
+#include <type_traits>
 
 namespace anzu {
 namespace {
 
-template <typename T>
-auto to_type_name() -> type_name
-{
-    if constexpr (std::is_same_v<T, std::int32_t>) {
-        return i32_type();
-    } else if constexpr (std::is_same_v<T, std::int64_t>) {
-        return i64_type();
-    } else if constexpr (std::is_same_v<T, std::uint64_t>) {
-        return u64_type();
-    } else if constexpr (std::is_same_v<T, double>) {
-        return f64_type();
-    } else {
-        static_assert(false);
-    }
-}
-
 template <typename Type, template <typename> typename Op>
 auto bin_op(std::vector<std::byte>& mem) -> void
 {
@@ -34,6 +21,35 @@ auto bin_op(std::vector<std::byte>& mem) -> void
     push_value(mem, op(lhs, rhs));
 }
 
+// Integer division by zero, or of the smallest signed value by -1, has no result
+template <typename T>
+struct checked_divides
+{
+    constexpr auto operator()(T lhs, T rhs) const -> T
+    {
+        if constexpr (std::is_integral_v<T>) {
+            if (rhs == 0) throw runtime_error{"division by zero\n"};
+            if constexpr (std::is_signed_v<T>) {
+                if (lhs == std::numeric_limits<T>::min() && rhs == -1) throw runtime_error{"division overflow\n"};
+            }
+        }
+        return lhs / rhs;
+    }
+};
+
+template <typename T>
+struct checked_modulus
+{
+    constexpr auto operator()(T lhs, T rhs) const -> T
+    {
+        if (rhs == 0) throw runtime_error{"division by zero\n"};
+        if constexpr (std::is_signed_v<T>) {
+            if (lhs == std::numeric_limits<T>::min() && rhs == -1) throw runtime_error{"division overflow\n"};
+        }
+        return lhs % rhs;
+    }
+};
+
 auto ptr_addition(std::size_t type_size)
 {
     return [=](std::vector<std::byte>& mem) {
@@ -62,7 +78,7 @@ auto resolve_arithmetic_binary_op(std::string_view op) -> std::optional<binary_o
     } else if (op == tk_mul) {
         return binary_op_info{ bin_op<T, std::multiplies>, type };
     } else if (op == tk_div) {
-        return binary_op_info{ bin_op<T, std::divides>, type };
+        return binary_op_info{ bin_op<T, checked_divides>, type };
     }
     return std::nullopt;
 }
@@ -107,12 +123,119 @@ auto resolve_numerical_binary_op(std::string_view op) -> std::optional<binary_op
     }
     if constexpr (!std::is_floating_point_v<T>) {
         if (op == tk_mod) {
-            return binary_op_info{ bin_op<T, std::modulus>, to_type_name<T>() };
+            return binary_op_info{ bin_op<T, checked_modulus>, to_type_name<T>() };
         }
     }
     return std::nullopt;
 }
 
+// Applies the op to each lane of two vectors. The loop has a fixed trip count, so the C++
+// compiler can turn it into vector instructions on targets that have them.
+template <typename T, std::size_t N, template <typename> typename Op>
+auto simd_bin_op(std::vector<std::byte>& mem) -> void
+{
+    static constexpr auto op = Op<T>{};
+    const auto rhs = pop_value<std::array<T, N>>(mem);
+    const auto lhs = pop_value<std::array<T, N>>(mem);
+    auto result = std::array<decltype(op(lhs[0], rhs[0])), N>{};
+    for (std::size_t i = 0; i != N; ++i) {
+        result[i] = op(lhs[i], rhs[i]);
+    }
+    push_value(mem, result);
+}
+
+template <typename T, std::size_t N, template <typename> typename Op>
+auto simd_unary_op(std::vector<std::byte>& mem) -> void
+{
+    static constexpr auto op = Op<T>{};
+    const auto obj = pop_value<std::array<T, N>>(mem);
+    auto result = std::array<decltype(op(obj[0])), N>{};
+    for (std::size_t i = 0; i != N; ++i) {
+        result[i] = op(obj[i]);
+    }
+    push_value(mem, result);
+}
+
+template <typename T, std::size_t N>
+auto resolve_simd_binary_op(std::string_view op) -> std::optional<binary_op_info>
+{
+    const auto type = simd_type(to_type_name<T>(), N);
+    const auto mask = simd_type(bool_type(), N);
+    if (op == tk_eq) {
+        return binary_op_info{ simd_bin_op<T, N, std::equal_to>, mask };
+    } else if (op == tk_ne) {
+        return binary_op_info{ simd_bin_op<T, N, std::not_equal_to>, mask };
+    }
+    if constexpr (!std::is_same_v<T, bool>) {
+        if (op == tk_add) {
+            return binary_op_info{ simd_bin_op<T, N, std::plus>, type };
+        } else if (op == tk_sub) {
+            return binary_op_info{ simd_bin_op<T, N, std::minus>, type };
+        } else if (op == tk_mul) {
+            return binary_op_info{ simd_bin_op<T, N, std::multiplies>, type };
+        } else if (op == tk_div) {
+            return binary_op_info{ simd_bin_op<T, N, checked_divides>, type };
+        } else if (op == tk_lt) {
+            return binary_op_info{ simd_bin_op<T, N, std::less>, mask };
+        } else if (op == tk_le) {
+            return binary_op_info{ simd_bin_op<T, N, std::less_equal>, mask };
+        } else if (op == tk_gt) {
+            return binary_op_info{ simd_bin_op<T, N, std::greater>, mask };
+        } else if (op == tk_ge) {
+            return binary_op_info{ simd_bin_op<T, N, std::greater_equal>, mask };
+        }
+        if constexpr (!std::is_floating_point_v<T>) {
+            if (op == tk_mod) {
+                return binary_op_info{ simd_bin_op<T, N, checked_modulus>, type };
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+template <typename T, std::size_t N>
+auto resolve_simd_unary_op(std::string_view op) -> std::optional<unary_op_info>
+{
+    if constexpr (std::is_same_v<T, bool>) {
+        if (op == tk_bang) {
+            return unary_op_info{ simd_unary_op<T, N, std::logical_not>, simd_type(bool_type(), N) };
+        }
+    } else if constexpr (std::is_signed_v<T>) {
+        if (op == tk_sub) {
+            return unary_op_info{ simd_unary_op<T, N, std::negate>, simd_type(to_type_name<T>(), N) };
+        }
+    }
+    return std::nullopt;
+}
+
+// Calls the function with tags for the C++ type of the lanes of the given vector type and the
+// number of lanes, so that it can instantiate the op for them.
+template <typename Func>
+auto visit_simd_type(const type_name& type, Func&& func)
+{
+    const auto with_lanes = [&]<typename T>(std::type_identity<T> tag) {
+        switch (simd_lanes(type)) {
+            case 2:  return func(tag, std::integral_constant<std::size_t, 2>{});
+            case 4:  return func(tag, std::integral_constant<std::size_t, 4>{});
+            case 8:  return func(tag, std::integral_constant<std::size_t, 8>{});
+            default: return func(tag, std::integral_constant<std::size_t, 16>{});
+        }
+    };
+
+    const auto lane_type = inner_type(type);
+    if (lane_type == i8_type())  return with_lanes(std::type_identity<std::int8_t>{});
+    if (lane_type == i16_type()) return with_lanes(std::type_identity<std::int16_t>{});
+    if (lane_type == i32_type()) return with_lanes(std::type_identity<std::int32_t>{});
+    if (lane_type == i64_type()) return with_lanes(std::type_identity<std::int64_t>{});
+    if (lane_type == u8_type())  return with_lanes(std::type_identity<std::uint8_t>{});
+    if (lane_type == u16_type()) return with_lanes(std::type_identity<std::uint16_t>{});
+    if (lane_type == u32_type()) return with_lanes(std::type_identity<std::uint32_t>{});
+    if (lane_type == u64_type()) return with_lanes(std::type_identity<std::uint64_t>{});
+    if (lane_type == f32_type()) return with_lanes(std::type_identity<float>{});
+    if (lane_type == f64_type()) return with_lanes(std::type_identity<double>{});
+    return with_lanes(std::type_identity<bool>{});
+}
+
 }
 
 auto resolve_binary_op(
@@ -120,7 +243,7 @@ auto resolve_binary_op(
 ) -> std::optional<binary_op_info>
 {
     if (is_ptr_type(desc.lhs) && desc.rhs == u64_type()) {
-        return binary_op_info{ ptr_addition(types.size_of(desc.lhs)), desc.lhs };
+        return binary_op_info{ ptr_addition(types.size_of(inner_type(desc.lhs))), desc.lhs };
     }
 
     if (desc.lhs != desc.rhs) {
@@ -133,19 +256,45 @@ auto resolve_binary_op(
         return std::nullopt;
     }
 
-    if (type == i32_type()) {
+    if (is_simd_type(type)) {
+        return visit_simd_type(type, [&]<typename T, std::size_t N>(std::type_identity<T>, std::integral_constant<std::size_t, N>) {
+            return resolve_simd_binary_op<T, N>(desc.op);
+        });
+    }
+
+    if (type == i8_type()) {
+        return resolve_numerical_binary_op<std::int8_t>(desc.op);
+    }
+    else if (type == i16_type()) {
+        return resolve_numerical_binary_op<std::int16_t>(desc.op);
+    }
+    else if (type == i32_type()) {
         return resolve_numerical_binary_op<std::int32_t>(desc.op);
     }
     else if (type == i64_type()) {
         return resolve_numerical_binary_op<std::int64_t>(desc.op);
     }
+    else if (type == u8_type()) {
+        return resolve_numerical_binary_op<std::uint8_t>(desc.op);
+    }
+    else if (type == u16_type()) {
+        return resolve_numerical_binary_op<std::uint16_t>(desc.op);
+    }
+    else if (type == u32_type()) {
+        return resolve_numerical_binary_op<std::uint32_t>(desc.op);
+    }
     else if (type == u64_type()) {
         return resolve_numerical_binary_op<std::uint64_t>(desc.op);
     }
+    else if (type == f32_type()) {
+        return resolve_numerical_binary_op<float>(desc.op);
+    }
     else if (type == f64_type()) {
         return resolve_numerical_binary_op<double>(desc.op);
     }
     else if (type == bool_type()) {
+        // The compiler emits jumps for these so that they short circuit, so these are only
+        // used when the operands are known to both be evaluated.
         if (desc.op == tk_and) {
             return binary_op_info{ bin_op<bool, std::logical_and>, type };
         }
@@ -168,7 +317,22 @@ auto resolve_binary_op(
 auto resolve_unary_op(const unary_op_description& desc) -> std::optional<unary_op_info>
 {
     const auto& type = desc.type;
-    if (type == i32_type()) {
+    if (is_simd_type(type)) {
+        return visit_simd_type(type, [&]<typename T, std::size_t N>(std::type_identity<T>, std::integral_constant<std::size_t, N>) {
+            return resolve_simd_unary_op<T, N>(desc.op);
+        });
+    }
+    else if (type == i8_type()) {
+        if (desc.op == tk_sub) {
+            return unary_op_info{ unary_op<std::int8_t, std::negate>, type };
+        }
+    }
+    else if (type == i16_type()) {
+        if (desc.op == tk_sub) {
+            return unary_op_info{ unary_op<std::int16_t, std::negate>, type };
+        }
+    }
+    else if (type == i32_type()) {
         if (desc.op == tk_sub) {
             return unary_op_info{ unary_op<std::int32_t, std::negate>, type };
         }
@@ -178,6 +342,11 @@ auto resolve_unary_op(const unary_op_description& desc) -> std::optional<unary_o
             return unary_op_info{ unary_op<std::int64_t, std::negate>, type };
         }
     }
+    else if (type == f32_type()) {
+        if (desc.op == tk_sub) {
+            return unary_op_info{ unary_op<float, std::negate>, type };
+        }
+    }
     else if (type == f64_type()) {
         if (desc.op == tk_sub) {
             return unary_op_info{ unary_op<double, std::negate>, type };
@@ -0,0 +1,471 @@
+#include "optimiser.hpp"
+#include "object.hpp"
+#include "operators.hpp"
+#include "vocabulary.hpp"
+#include "utility/overloaded.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace anzu {
+namespace {
+
+struct var_state
+{
+    std::optional<type_name> type;
+    std::optional<object>    value; // Set if the variable is a constant that can be propagated
+};
+
+struct optimiser
+{
+    type_store types;
+
+    // Names of variables that may change after being declared, either by being assigned to or
+    // by having their address taken. This is by name rather than by declaration, which is
+    // conservative when names are reused.
+    std::unordered_set<std::string> modified;
+
+    std::vector<std::unordered_map<std::string, var_state>> scopes;
+};
+
+// Returns the name of the variable that the given lvalue expression is a part of, if any.
+auto root_variable(const node_expr& node) -> std::optional<std::string>
+{
+    return std::visit(overloaded{
+        [](const node_variable_expr& expr) -> std::optional<std::string> { return expr.name; },
+        [](const node_field_expr& expr) { return root_variable(*expr.expr); },
+        [](const node_subscript_expr& expr) { return root_variable(*expr.expr); },
+        [](const auto&) -> std::optional<std::string> { return std::nullopt; }
+    }, node);
+}
+
+auto mark_modified(optimiser& opt, const node_expr& node) -> void
+{
+    if (const auto name = root_variable(node); name.has_value()) {
+        opt.modified.insert(*name);
+    }
+}
+
+auto collect_modified(optimiser& opt, const node_expr& node) -> void;
+auto collect_modified(optimiser& opt, const node_stmt& node) -> void;
+
+auto collect_modified(optimiser& opt, const node_expr& node) -> void
+{
+    std::visit(overloaded{
+        [&](const node_literal_expr&) {},
+        [&](const node_variable_expr&) {},
+        [&](const node_field_expr& expr) { collect_modified(opt, *expr.expr); },
+        [&](const node_unary_op_expr& expr) { collect_modified(opt, *expr.expr); },
+        [&](const node_binary_op_expr& expr) {
+            collect_modified(opt, *expr.lhs);
+            collect_modified(opt, *expr.rhs);
+        },
+        [&](const node_function_call_expr& expr) {
+            for (const auto& arg : expr.args) { collect_modified(opt, *arg); }
+        },
+        [&](const node_member_function_call_expr& expr) {
+            mark_modified(opt, *expr.expr); // The object is passed by pointer
+            collect_modified(opt, *expr.expr);
+            for (const auto& arg : expr.args) { collect_modified(opt, *arg); }
+        },
+        [&](const node_list_expr& expr) {
+            for (const auto& element : expr.elements) { collect_modified(opt, *element); }
+        },
+        [&](const node_repeat_list_expr& expr) { collect_modified(opt, *expr.value); },
+        [&](const node_addrof_expr& expr) {
+            mark_modified(opt, *expr.expr);
+            collect_modified(opt, *expr.expr);
+        },
+        [&](const node_deref_expr& expr) { collect_modified(opt, *expr.expr); },
+        [&](const node_sizeof_expr&) {}, // Not evaluated
+        [&](const node_subscript_expr& expr) {
+            collect_modified(opt, *expr.expr);
+            collect_modified(opt, *expr.index);
+        },
+        [&](const node_slice_expr& expr) {
+            mark_modified(opt, *expr.expr); // The elements may be modified through the slice
+            collect_modified(opt, *expr.expr);
+            collect_modified(opt, *expr.lower);
+            collect_modified(opt, *expr.upper);
+        },
+        [&](const node_new_expr& expr) { collect_modified(opt, *expr.size); }
+    }, node);
+}
+
+auto collect_modified(optimiser& opt, const node_stmt& node) -> void
+{
+    std::visit(overloaded{
+        [&](const node_sequence_stmt& stmt) {
+            for (const auto& s : stmt.sequence) { collect_modified(opt, *s); }
+        },
+        [&](const node_while_stmt& stmt) {
+            collect_modified(opt, *stmt.condition);
+            collect_modified(opt, *stmt.body);
+        },
+        [&](const node_if_stmt& stmt) {
+            collect_modified(opt, *stmt.condition);
+            collect_modified(opt, *stmt.body);
+            if (stmt.else_body) { collect_modified(opt, *stmt.else_body); }
+        },
+        [&](const node_struct_stmt& stmt) {
+            for (const auto& function : stmt.functions) { collect_modified(opt, *function); }
+        },
+        [&](const node_break_stmt&) {},
+        [&](const node_continue_stmt&) {},
+        [&](const node_declaration_stmt& stmt) { collect_modified(opt, *stmt.expr); },
+        [&](const node_assignment_stmt& stmt) {
+            mark_modified(opt, *stmt.position);
+            collect_modified(opt, *stmt.position);
+            collect_modified(opt, *stmt.expr);
+        },
+        [&](const node_function_def_stmt& stmt) { collect_modified(opt, *stmt.body); },
+        [&](const node_member_function_def_stmt& stmt) { collect_modified(opt, *stmt.body); },
+        [&](const node_expression_stmt& stmt) { collect_modified(opt, *stmt.expr); },
+        [&](const node_return_stmt& stmt) { collect_modified(opt, *stmt.return_value); },
+        [&](const node_delete_stmt& stmt) { collect_modified(opt, *stmt.expr); }
+    }, node);
+}
+
+auto find_var(const optimiser& opt, const std::string& name) -> const var_state*
+{
+    for (const auto& scope : opt.scopes | std::views::reverse) {
+        if (const auto it = scope.find(name); it != scope.end()) {
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
+
+// Returns true if the size of the given type is known, which is not the case for structs that
+// have not been seen or that have fields of unknown types.
+auto is_sized(const optimiser& opt, const type_name& type) -> bool
+{
+    if (!opt.types.contains(type)) {
+        return false;
+    }
+    if (is_list_type(type)) {
+        return is_sized(opt, inner_type(type));
+    }
+    return std::ranges::all_of(opt.types.fields_of(type), [&](const field& f) {
+        return is_sized(opt, f.type);
+    });
+}
+
+// Attempts to determine the type of an expression without compiling it. This only needs to
+// handle enough cases to be able to fold common sizeof and short circuiting expressions. A
+// type is only returned for operators if the compiler would accept their operands.
+auto static_type_of(const optimiser& opt, const node_expr& node) -> std::optional<type_name>
+{
+    return std::visit(overloaded{
+        [&](const node_literal_expr& expr) -> std::optional<type_name> {
+            return expr.value.type;
+        },
+        [&](const node_variable_expr& expr) -> std::optional<type_name> {
+            if (const auto var = find_var(opt, expr.name); var) {
+                return var->type;
+            }
+            return std::nullopt;
+        },
+        [&](const node_list_expr& expr) -> std::optional<type_name> {
+            if (const auto inner = static_type_of(opt, *expr.elements.front()); inner) {
+                return concrete_list_type(*inner, expr.elements.size());
+            }
+            return std::nullopt;
+        },
+        [&](const node_repeat_list_expr& expr) -> std::optional<type_name> {
+            if (const auto inner = static_type_of(opt, *expr.value); inner) {
+                return concrete_list_type(*inner, expr.size);
+            }
+            return std::nullopt;
+        },
+        [&](const node_subscript_expr& expr) -> std::optional<type_name> {
+            if (const auto type = static_type_of(opt, *expr.expr); type && is_list_type(*type)) {
+                return inner_type(*type);
+            }
+            return std::nullopt;
+        },
+        [&](const node_field_expr& expr) -> std::optional<type_name> {
+            if (const auto type = static_type_of(opt, *expr.expr); type) {
+                for (const auto& field : opt.types.fields_of(*type)) {
+                    if (field.name == expr.field_name) {
+                        return field.type;
+                    }
+                }
+            }
+            return std::nullopt;
+        },
+        [&](const node_function_call_expr& expr) -> std::optional<type_name> {
+            if (const auto type = make_type(expr.function_name); opt.types.contains(type)) {
+                return type; // Constructor call
+            }
+            return std::nullopt;
+        },
+        [&](const node_addrof_expr& expr) -> std::optional<type_name> {
+            if (const auto type = static_type_of(opt, *expr.expr); type) {
+                return concrete_ptr_type(*type);
+            }
+            return std::nullopt;
+        },
+        [&](const node_deref_expr& expr) -> std::optional<type_name> {
+            if (const auto type = static_type_of(opt, *expr.expr); type && is_ptr_type(*type)) {
+                return inner_type(*type);
+            }
+            return std::nullopt;
+        },
+        [&](const node_sizeof_expr&) -> std::optional<type_name> {
+            return u64_type();
+        },
+        [&](const node_binary_op_expr& expr) -> std::optional<type_name> {
+            const auto lhs = static_type_of(opt, *expr.lhs);
+            const auto rhs = static_type_of(opt, *expr.rhs);
+            if (!lhs || !rhs) {
+                return std::nullopt;
+            }
+            const auto info = resolve_binary_op(opt.types, { .op=expr.token.text, .lhs=*lhs, .rhs=*rhs });
+            if (!info) {
+                return std::nullopt;
+            }
+            return info->result_type;
+        },
+        [&](const node_unary_op_expr& expr) -> std::optional<type_name> {
+            const auto type = static_type_of(opt, *expr.expr);
+            if (!type) {
+                return std::nullopt;
+            }
+            const auto info = resolve_unary_op({ .op=expr.token.text, .type=*type });
+            if (!info) {
+                return std::nullopt;
+            }
+            return info->result_type;
+        },
+        [&](const node_new_expr& expr) -> std::optional<type_name> {
+            return opt.types.is_soa(expr.type) ? concrete_slice_type(expr.type) : concrete_ptr_type(expr.type);
+        },
+        [&](const auto&) -> std::optional<type_name> {
+            return std::nullopt;
+        }
+    }, node);
+}
+
+auto make_literal(const object& value, const token& tok) -> node_expr
+{
+    auto ret = node_expr{};
+    ret.emplace<node_literal_expr>(node_literal_expr{ .value=value, .token=tok });
+    return ret;
+}
+
+auto get_literal(const node_expr_ptr& node) -> const object*
+{
+    if (auto literal = std::get_if<node_literal_expr>(node.get())) {
+        return &literal->value;
+    }
+    return nullptr;
+}
+
+auto is_integral(const type_name& type) -> bool
+{
+    return type == i8_type() || type == i16_type() || type == i32_type() || type == i64_type()
+        || type == u8_type() || type == u16_type() || type == u32_type() || type == u64_type();
+}
+
+// Evaluates the binary op with the same operator functions used at runtime. Returns nullopt
+// if the op cannot be evaluated at compile time.
+auto fold_binary_op(
+    const optimiser& opt, std::string_view op, const object& lhs, const object& rhs
+)
+    -> std::optional<object>
+{
+    const auto info = resolve_binary_op(opt.types, { .op=std::string{op}, .lhs=lhs.type, .rhs=rhs.type });
+    if (!info.has_value()) {
+        return std::nullopt; // Let the compiler report the error
+    }
+
+    auto mem = lhs.data;
+    mem.insert(mem.end(), rhs.data.begin(), rhs.data.end());
+    try {
+        info->operator_func(mem);
+    } catch (const runtime_error&) {
+        return std::nullopt; // Leave ops that fail, such as division by zero, to fail at runtime
+    }
+    return object{ .data=mem, .type=info->result_type };
+}
+
+auto fold_unary_op(std::string_view op, const object& value) -> std::optional<object>
+{
+    const auto info = resolve_unary_op({ .op=std::string{op}, .type=value.type });
+    if (!info.has_value()) {
+        return std::nullopt;
+    }
+    auto mem = value.data;
+    info->operator_func(mem);
+    return object{ .data=mem, .type=info->result_type };
+}
+
+auto fold(optimiser& opt, node_expr_ptr& node) -> void;
+auto fold(optimiser& opt, node_stmt_ptr& node) -> void;
+
+auto fold(optimiser& opt, node_expr_ptr& node) -> void
+{
+    auto result = std::optional<node_expr>{};
+
+    std::visit(overloaded{
+        [&](node_literal_expr&) {},
+        [&](node_variable_expr& expr) {
+            if (const auto var = find_var(opt, expr.name); var && var->value) {
+                result = make_literal(*var->value, expr.token);
+            }
+        },
+        [&](node_field_expr& expr) { fold(opt, expr.expr); },
+        [&](node_unary_op_expr& expr) {
+            fold(opt, expr.expr);
+            if (const auto value = get_literal(expr.expr)) {
+                if (const auto folded = fold_unary_op(expr.token.text, *value)) {
+                    result = make_literal(*folded, expr.token);
+                }
+            }
+        },
+        [&](node_binary_op_expr& expr) {
+            fold(opt, expr.lhs);
+            fold(opt, expr.rhs);
+            const auto lhs = get_literal(expr.lhs);
+            const auto rhs = get_literal(expr.rhs);
+
+            // A constant lhs of a short circuiting op either decides the result or reduces
+            // the expression to the rhs. Both skip the compiler's check that the rhs is a
+            // bool, so only fold if the rhs is already known to be one.
+            const auto is_and = expr.token.text == tk_and;
+            const auto short_circuits = is_and || expr.token.text == tk_or;
+            if (short_circuits && lhs && lhs->type == bool_type() && static_type_of(opt, *expr.rhs) == bool_type()) {
+                const auto lhs_value = lhs->data.front() == std::byte{1};
+                if (lhs_value != is_and) {
+                    result = make_literal(*lhs, expr.token);
+                } else {
+                    result = std::move(*expr.rhs);
+                }
+                return;
+            }
+
+            if (lhs && rhs) {
+                if (const auto folded = fold_binary_op(opt, expr.token.text, *lhs, *rhs)) {
+                    result = make_literal(*folded, expr.token);
+                }
+            }
+        },
+        [&](node_function_call_expr& expr) {
+            for (auto& arg : expr.args) { fold(opt, arg); }
+        },
+        [&](node_member_function_call_expr& expr) {
+            fold(opt, expr.expr);
+            for (auto& arg : expr.args) { fold(opt, arg); }
+        },
+        [&](node_list_expr& expr) {
+            for (auto& element : expr.elements) { fold(opt, element); }
+        },
+        [&](node_repeat_list_expr& expr) { fold(opt, expr.value); },
+        [&](node_addrof_expr& expr) { fold(opt, expr.expr); },
+        [&](node_deref_expr& expr) { fold(opt, expr.expr); },
+        [&](node_sizeof_expr& expr) {
+            if (const auto type = static_type_of(opt, *expr.expr); type && is_sized(opt, *type)) {
+                const auto bytes = as_bytes(opt.types.size_of(*type));
+                const auto value = object{ .data={bytes.begin(), bytes.end()}, .type=u64_type() };
+                result = make_literal(value, expr.token);
+            }
+        },
+        [&](node_subscript_expr& expr) {
+            fold(opt, expr.expr);
+            fold(opt, expr.index);
+        },
+        [&](node_slice_expr& expr) {
+            fold(opt, expr.expr);
+            fold(opt, expr.lower);
+            fold(opt, expr.upper);
+        },
+        [&](node_new_expr& expr) { fold(opt, expr.size); }
+    }, *node);
+
+    if (result.has_value()) {
+        *node = std::move(*result);
+    }
+}
+
+auto declare(optimiser& opt, const std::string& name, const var_state& state) -> void
+{
+    opt.scopes.back()[name] = state;
+}
+
+auto fold_function(optimiser& opt, const signature& sig, node_stmt_ptr& body) -> void
+{
+    opt.scopes.emplace_back();
+    for (const auto& param : sig.params) {
+        declare(opt, param.name, { .type=param.type, .value=std::nullopt });
+    }
+    fold(opt, body);
+    opt.scopes.pop_back();
+}
+
+auto fold(optimiser& opt, node_stmt_ptr& node) -> void
+{
+    std::visit(overloaded{
+        [&](node_sequence_stmt& stmt) {
+            opt.scopes.emplace_back();
+            for (auto& s : stmt.sequence) { fold(opt, s); }
+            opt.scopes.pop_back();
+        },
+        [&](node_while_stmt& stmt) {
+            fold(opt, stmt.condition);
+            fold(opt, stmt.body);
+        },
+        [&](node_if_stmt& stmt) {
+            fold(opt, stmt.condition);
+            fold(opt, stmt.body);
+            if (stmt.else_body) { fold(opt, stmt.else_body); }
+        },
+        [&](node_struct_stmt& stmt) {
+            opt.types.add(make_type(stmt.name), stmt.fields, stmt.is_soa);
+            for (auto& function : stmt.functions) { fold(opt, function); }
+        },
+        [&](node_break_stmt&) {},
+        [&](node_continue_stmt&) {},
+        [&](node_declaration_stmt& stmt) {
+            fold(opt, stmt.expr);
+            auto state = var_state{ .type=static_type_of(opt, *stmt.expr), .value=std::nullopt };
+
+            // Only propagate fundamental values, lists may be used as lvalues
+            const auto literal = get_literal(stmt.expr);
+            if (literal && !is_list_type(literal->type) && !opt.modified.contains(stmt.name)) {
+                state.value = *literal;
+            }
+            declare(opt, stmt.name, state);
+        },
+        [&](node_assignment_stmt& stmt) {
+            fold(opt, stmt.position);
+            fold(opt, stmt.expr);
+        },
+        [&](node_function_def_stmt& stmt) { fold_function(opt, stmt.sig, stmt.body); },
+        [&](node_member_function_def_stmt& stmt) { fold_function(opt, stmt.sig, stmt.body); },
+        [&](node_expression_stmt& stmt) { fold(opt, stmt.expr); },
+        [&](node_return_stmt& stmt) { fold(opt, stmt.return_value); },
+        [&](node_delete_stmt& stmt) { fold(opt, stmt.expr); }
+    }, *node);
+}
+
+}
+
+auto optimise(node_stmt_ptr& root, int level, bool aligned_layout) -> void
+{
+    if (level < 1) {
+        return;
+    }
+
+    auto opt = optimiser{};
+    opt.types = type_store{aligned_layout};
+    collect_modified(opt, *root);
+    fold(opt, root);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+#include "ast.hpp"
+
+namespace anzu {
+
+// Optimises the AST in place before it is compiled. Level 0 does nothing. Level 1 folds
+// constant subexpressions, including sizeof expressions with a known type, and replaces uses of
+// locals that are declared with a constant and never modified by that constant.
+auto optimise(node_stmt_ptr& root, int level, bool aligned_layout = false) -> void;
+
+}
\ No newline at end of file
@@ -28,19 +28,21 @@ void parser_assert(bool cond, const token& tok, std::string_view msg, Args&&...
     }
 }
 
-auto parse_i32(const token& tok) -> object
+// Parses an integer literal that ends with the name of its type, such as 5i32 or 255u8
+template <typename T>
+auto parse_suffixed_int(const token& tok, std::string_view suffix, const type_name& type) -> object
 {
     auto text = std::string_view{tok.text};
 
-    parser_assert(text.ends_with(tk_i32), tok, "expected suffix '{}'\n", tk_i32);
-    text.remove_suffix(tk_i32.size());
+    parser_assert(text.ends_with(suffix), tok, "expected suffix '{}'\n", suffix);
+    text.remove_suffix(suffix.size());
     
-    auto result = std::int32_t{};
+    auto result = T{};
     const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), result);
-    parser_assert(ec == std::errc{}, tok, "cannot convert '{}' to '{}'\n", text, tk_i32);
+    parser_assert(ec == std::errc{}, tok, "cannot convert '{}' to '{}'\n", text, suffix);
 
     const auto bytes = as_bytes(result);
-    return object{ .data={bytes.begin(), bytes.end()}, .type=i32_type() };
+    return object{ .data={bytes.begin(), bytes.end()}, .type=type };
 }
 
 auto parse_i64(const token& tok) -> object
@@ -89,6 +91,21 @@ auto parse_f64(const token& tok) -> object
     return object{ .data={bytes.begin(), bytes.end()}, .type=f64_type() };
 }
 
+auto parse_f32(const token& tok) -> object
+{
+    auto text = std::string_view{tok.text};
+
+    parser_assert(text.ends_with(tk_f32), tok, "expected suffix '{}'\n", tk_f32);
+    text.remove_suffix(tk_f32.size());
+
+    auto result = float{};
+    const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), result);
+    parser_assert(ec == std::errc{}, tok, "cannot convert '{}' to '{}'\n", text, tk_f32);
+
+    const auto bytes = as_bytes(result);
+    return object{ .data={bytes.begin(), bytes.end()}, .type=f32_type() };
+}
+
 auto parse_char(const token& tok) -> object
 {
     parser_assert(tok.text.size() == 1, tok, "failed to parse char");
@@ -103,15 +120,33 @@ auto parse_type(tokenstream& tokens) -> type_name;
 
 auto parse_literal(tokenstream& tokens) -> object
 {
+    if (tokens.curr().type == token_type::i8) {
+        return parse_suffixed_int<std::int8_t>(tokens.consume(), tk_i8, i8_type());
+    }
+    if (tokens.curr().type == token_type::i16) {
+        return parse_suffixed_int<std::int16_t>(tokens.consume(), tk_i16, i16_type());
+    }
     if (tokens.curr().type == token_type::i32) {
-        return parse_i32(tokens.consume());
+        return parse_suffixed_int<std::int32_t>(tokens.consume(), tk_i32, i32_type());
     }
     if (tokens.curr().type == token_type::i64) {
         return parse_i64(tokens.consume());
     }
+    if (tokens.curr().type == token_type::u8) {
+        return parse_suffixed_int<std::uint8_t>(tokens.consume(), tk_u8, u8_type());
+    }
+    if (tokens.curr().type == token_type::u16) {
+        return parse_suffixed_int<std::uint16_t>(tokens.consume(), tk_u16, u16_type());
+    }
+    if (tokens.curr().type == token_type::u32) {
+        return parse_suffixed_int<std::uint32_t>(tokens.consume(), tk_u32, u32_type());
+    }
     if (tokens.curr().type == token_type::u64) {
         return parse_u64(tokens.consume());
     }
+    if (tokens.curr().type == token_type::f32) {
+        return parse_f32(tokens.consume());
+    }
     if (tokens.curr().type == token_type::f64) {
         return parse_f64(tokens.consume());
     }
@@ -159,6 +194,10 @@ auto parse_function_call(tokenstream& tokens) -> node_expr_ptr
     out.token = tokens.consume();
 
     out.function_name = out.token.text;
+    if (tokens.consume_maybe(tk_lt)) {
+        out.templates.push_back(parse_type(tokens));
+        tokens.consume_only(tk_gt);
+    }
     tokens.consume_only(tk_lparen);
     tokens.consume_comma_separated_list(tk_rparen, [&] {
         out.args.push_back(parse_expression(tokens));
@@ -240,7 +279,7 @@ auto parse_single_factor(tokenstream& tokens) -> node_expr_ptr
         expr.token = tokens.consume();
         expr.expr = parse_single_factor(tokens);
     }
-    else if (tokens.peek_next(tk_lparen)) {
+    else if (tokens.peek_next(tk_lparen) || tokens.peek(tk_vec)) {
         node = parse_function_call(tokens);
     }
     else if (tokens.curr().type == token_type::name) {
@@ -283,11 +322,23 @@ auto parse_single_factor(tokenstream& tokens) -> node_expr_ptr
         
         else {
             auto new_node = std::make_unique<node_expr>();
-            auto& expr = new_node->emplace<node_subscript_expr>();
-            expr.token = tokens.consume();
-            expr.index = parse_expression(tokens);
+            const auto tok = tokens.consume();
+            auto index = parse_expression(tokens);
+
+            // x[a:b] is a slice of x rather than a single element
+            if (tokens.consume_maybe(tk_colon)) {
+                auto& expr = new_node->emplace<node_slice_expr>();
+                expr.token = tok;
+                expr.lower = std::move(index);
+                expr.upper = parse_expression(tokens);
+                expr.expr = std::move(node);
+            } else {
+                auto& expr = new_node->emplace<node_subscript_expr>();
+                expr.token = tok;
+                expr.index = std::move(index);
+                expr.expr = std::move(node);
+            }
             tokens.consume_only(tk_rbracket);
-            expr.expr = std::move(node);
             node = std::move(new_node);
         }
     }
@@ -331,9 +382,19 @@ auto parse_name(tokenstream& tokens)
 auto parse_type(tokenstream& tokens) -> type_name
 {
     if (tokens.consume_maybe(tk_ampersand)) {
+        if (tokens.consume_maybe(tk_lbracket)) {
+            const auto inner = parse_type(tokens);
+            tokens.consume_only(tk_rbracket);
+            return concrete_slice_type(inner);
+        }
         return {type_ptr{ .inner_type={parse_type(tokens)} }};
     }
     auto type = type_name{type_simple{.name=tokens.consume().text}};
+    if (type == make_type(std::string{tk_vec})) {
+        tokens.consume_only(tk_lt);
+        type = concrete_vec_type(parse_type(tokens));
+        tokens.consume_only(tk_gt);
+    }
     while (tokens.consume_maybe(tk_lbracket)) {
         auto new_type = type_name{type_list{
             .inner_type=type, .count=static_cast<std::size_t>(tokens.consume_i64())
@@ -349,6 +410,14 @@ auto parse_function_def_stmt(tokenstream& tokens) -> node_stmt_ptr
     auto node = std::make_unique<node_stmt>();
     auto& stmt = node->emplace<node_function_def_stmt>();
 
+    while (tokens.peek(tk_inline) || tokens.peek(tk_memo)) {
+        if (tokens.consume_maybe(tk_inline)) {
+            stmt.is_inline = true;
+        } else {
+            tokens.consume_only(tk_memo);
+            stmt.is_memo = true;
+        }
+    }
     stmt.token = tokens.consume_only(tk_function);
     stmt.name = parse_name(tokens);
     tokens.consume_only(tk_lparen);
@@ -373,6 +442,15 @@ auto parse_member_function_def_stmt(
     auto node = std::make_unique<node_stmt>();
     auto& stmt = node->emplace<node_member_function_def_stmt>();
 
+    // Memoised results are keyed by the bytes of the args, but member functions are passed a
+    // pointer to the object rather than its value, so the key would not capture its state
+    while (tokens.peek(tk_inline) || tokens.peek(tk_memo)) {
+        if (tokens.peek(tk_memo)) {
+            parser_error(tokens.curr(), "member function of '{}' cannot be memo, only free functions can", struct_name);
+        }
+        tokens.consume_only(tk_inline);
+        stmt.is_inline = true;
+    }
     stmt.token = tokens.consume_only(tk_function);
     stmt.struct_name = struct_name;
     stmt.function_name = parse_name(tokens);
@@ -438,11 +516,12 @@ auto parse_struct_stmt(tokenstream& tokens) -> node_stmt_ptr
     auto node = std::make_unique<node_stmt>();
     auto& stmt = node->emplace<node_struct_stmt>();
 
+    stmt.is_soa = tokens.consume_maybe(tk_soa);
     stmt.token = tokens.consume_only(tk_struct);
     stmt.name = parse_name(tokens);
     tokens.consume_only(tk_lbrace);
     while (!tokens.consume_maybe(tk_rbrace)) {
-        if (tokens.peek(tk_function)) {
+        if (tokens.peek(tk_function) || tokens.peek(tk_inline) || tokens.peek(tk_memo)) {
             stmt.functions.emplace_back(parse_member_function_def_stmt(stmt.name, tokens));
         } else {
             stmt.fields.emplace_back();
@@ -497,7 +576,7 @@ auto parse_delete_stmt(tokenstream& tokens) -> node_stmt_ptr
 auto parse_statement(tokenstream& tokens) -> node_stmt_ptr
 {
     while (tokens.consume_maybe(tk_semicolon));
-    if (tokens.peek(tk_function) || tokens.peek(tk_struct)) {
+    if (tokens.peek(tk_function) || tokens.peek(tk_inline) || tokens.peek(tk_memo) || tokens.peek(tk_struct) || tokens.peek(tk_soa)) {
         parser_error(tokens.curr(), "functions and structs can only be declared in the global scope");
     }
     if (tokens.peek(tk_return)) {
@@ -549,10 +628,10 @@ auto parse_statement(tokenstream& tokens) -> node_stmt_ptr
 auto parse_top_level_statement(tokenstream& tokens) -> node_stmt_ptr
 {
     while (tokens.consume_maybe(tk_semicolon));
-    if (tokens.peek(tk_function)) {
+    if (tokens.peek(tk_function) || tokens.peek(tk_inline) || tokens.peek(tk_memo)) {
         return parse_function_def_stmt(tokens);
     }
-    if (tokens.peek(tk_struct)) {
+    if (tokens.peek(tk_struct) || tokens.peek(tk_soa)) {
         return parse_struct_stmt(tokens);
     }
     return parse_statement(tokens);
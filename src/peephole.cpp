@@ -0,0 +1,339 @@
+#include "peephole.hpp"
+#include "utility/overloaded.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace anzu {
+namespace {
+
+// Returns the absolute position that the op jumps to, if it is a relative jump.
+auto jump_target(const program& prog, std::size_t pos) -> std::optional<std::size_t>
+{
+    return std::visit(overloaded{
+        [&](const op_jump& op) -> std::optional<std::size_t> { return pos + op.jump; },
+        [&](const op_jump_if_false& op) -> std::optional<std::size_t> { return pos + op.jump; },
+        [&](const op_jump_if_true& op) -> std::optional<std::size_t> { return pos + op.jump; },
+        [&](const auto&) -> std::optional<std::size_t> { return std::nullopt; }
+    }, prog.code[pos]);
+}
+
+auto set_jump(op& op_code, std::size_t from, std::size_t to) -> void
+{
+    const auto jump = static_cast<std::int64_t>(to) - static_cast<std::int64_t>(from);
+    std::visit(overloaded{
+        [&](op_jump& op) { op.jump = jump; },
+        [&](op_jump_if_false& op) { op.jump = static_cast<std::size_t>(jump); },
+        [&](op_jump_if_true& op) { op.jump = jump; },
+        [&](auto&) {}
+    }, op_code);
+}
+
+// Positions that can be jumped to, either by a jump or a function call. Ops at these positions
+// may be removed, since jumps are redirected to the next op that remains, but they must not be
+// combined with the op before them.
+auto find_targets(const program& prog) -> std::vector<bool>
+{
+    auto targets = std::vector<bool>(prog.code.size() + 1, false);
+    for (std::size_t pos = 0; pos != prog.code.size(); ++pos) {
+        if (const auto target = jump_target(prog, pos)) {
+            targets[*target] = true;
+        }
+        else if (const auto func = std::get_if<op_function>(&prog.code[pos])) {
+            targets[func->jump] = true;
+        }
+        else if (const auto call = std::get_if<op_function_call>(&prog.code[pos])) {
+            targets[call->ptr] = true;
+        }
+        else if (const auto call = std::get_if<op_tail_call>(&prog.code[pos])) {
+            targets[call->ptr] = true;
+        }
+    }
+    return targets;
+}
+
+// Redirects jumps whose target is an unconditional jump. Returns true if any were changed.
+auto thread_jumps(program& prog) -> bool
+{
+    auto changed = false;
+    for (std::size_t pos = 0; pos != prog.code.size(); ++pos) {
+        const auto original = jump_target(prog, pos);
+        if (!original) continue;
+
+        auto target = *original;
+        for (std::size_t hops = 0; hops != prog.code.size(); ++hops) { // Guards against cycles
+            if (target >= prog.code.size() || target == pos) break;
+            const auto next = std::get_if<op_jump>(&prog.code[target]);
+            if (!next || next->jump == 0) break;
+            target += next->jump;
+        }
+
+        // JUMP_RELATIVE_IF_FALSE only jumps forwards
+        const auto is_jif = std::holds_alternative<op_jump_if_false>(prog.code[pos]);
+        if (target != *original && !(is_jif && target < pos)) {
+            set_jump(prog.code[pos], pos, target);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+auto is_zero_offset(const op& op_code) -> bool
+{
+    const auto load = std::get_if<op_load_bytes>(&op_code);
+    return load
+        && load->bytes.size() == sizeof(std::uint64_t)
+        && std::ranges::all_of(load->bytes, [](std::byte b) { return b == std::byte{0}; });
+}
+
+// Marks the ops to remove, and modifies ops that are combined with their neighbours. Returns
+// true if any ops were marked.
+auto simplify(program& prog, const peephole_options& options, std::vector<bool>& keep) -> bool
+{
+    const auto targets = find_targets(prog);
+    auto& code = prog.code;
+    auto changed = false;
+
+    const auto remove = [&](std::size_t pos) {
+        keep[pos] = false;
+        changed = true;
+    };
+
+    // The op after pos can be combined with the op at pos
+    const auto can_pair = [&](std::size_t pos) {
+        return pos + 1 < code.size() && !targets[pos + 1];
+    };
+
+    for (std::size_t pos = 0; pos < code.size(); ++pos) {
+        if (auto pop = std::get_if<op_pop>(&code[pos])) {
+            if (options.remove_empty_pops && pop->size == 0) {
+                remove(pos);
+                continue;
+            }
+            if (options.merge_pops) {
+                while (can_pair(pos) && std::holds_alternative<op_pop>(code[pos + 1])) {
+                    pop->size += std::get<op_pop>(code[pos + 1]).size;
+                    remove(pos + 1);
+                    ++pos;
+                }
+            }
+            continue;
+        }
+
+        if (!can_pair(pos)) continue;
+
+        if (options.remove_zero_offsets && is_zero_offset(code[pos])
+            && std::holds_alternative<op_modify_ptr>(code[pos + 1]))
+        {
+            remove(pos);
+            remove(pos + 1);
+            ++pos;
+            continue;
+        }
+
+        auto load = std::get_if<op_load_bytes>(&code[pos]);
+        auto pop = std::get_if<op_pop>(&code[pos + 1]);
+        if (options.remove_pushed_pops && load && pop) {
+            const auto pushed = load->bytes.size();
+            if (pop->size >= pushed) {
+                pop->size -= pushed;
+                remove(pos);
+                if (pop->size == 0) {
+                    remove(pos + 1);
+                    ++pos;
+                }
+            } else {
+                load->bytes.resize(pushed - pop->size);
+                remove(pos + 1);
+                ++pos;
+            }
+        }
+    }
+
+    return changed;
+}
+
+// Removes the ops not marked to keep and fixes up all jumps and function pointers.
+auto compact(program& prog, const std::vector<bool>& keep) -> void
+{
+    // The new position of each op, or of the next kept op if it is removed
+    auto new_pos = std::vector<std::size_t>(prog.code.size() + 1, 0);
+    for (std::size_t pos = 0, count = 0; pos != prog.code.size() + 1; ++pos) {
+        new_pos[pos] = count;
+        if (pos < prog.code.size() && keep[pos]) ++count;
+    }
+
+    for (std::size_t pos = 0; pos != prog.code.size(); ++pos) {
+        if (!keep[pos]) continue;
+        if (const auto target = jump_target(prog, pos)) {
+            set_jump(prog.code[pos], new_pos[pos], new_pos[*target]);
+        }
+        else if (auto func = std::get_if<op_function>(&prog.code[pos])) {
+            func->jump = new_pos[func->jump];
+        }
+        else if (auto call = std::get_if<op_function_call>(&prog.code[pos])) {
+            call->ptr = new_pos[call->ptr];
+        }
+        else if (auto call = std::get_if<op_tail_call>(&prog.code[pos])) {
+            call->ptr = new_pos[call->ptr];
+        }
+    }
+
+    auto code = std::vector<op>{};
+    code.reserve(new_pos.back());
+    for (std::size_t pos = 0; pos != prog.code.size(); ++pos) {
+        if (keep[pos]) {
+            code.push_back(std::move(prog.code[pos]));
+        }
+    }
+    prog.code = std::move(code);
+}
+
+// The register for the address pushed by the op, if it is the address of a variable
+auto address_register(const op& op_code) -> std::optional<reg_operand>
+{
+    if (const auto push = std::get_if<op_push_local_addr>(&op_code)) {
+        return reg_operand{ .src=reg_operand::source::local, .offset=push->offset };
+    }
+    if (const auto push = std::get_if<op_push_global_addr>(&op_code)) {
+        return reg_operand{ .src=reg_operand::source::global, .offset=push->position };
+    }
+    return std::nullopt;
+}
+
+// A value pushed by the ops at pos as a register operand, along with the number of ops: either
+// a constant, or a variable loaded through its address.
+auto read_register(const program& prog, const std::vector<bool>& targets, std::size_t pos)
+    -> std::optional<std::pair<reg_operand, std::size_t>>
+{
+    if (const auto load = std::get_if<op_load_bytes>(&prog.code[pos])) {
+        const auto reg = reg_operand{
+            .src=reg_operand::source::immediate, .size=load->bytes.size(), .bytes=load->bytes
+        };
+        return std::pair{reg, 1};
+    }
+    auto reg = address_register(prog.code[pos]);
+    if (!reg || pos + 1 >= prog.code.size() || targets[pos + 1]) return std::nullopt;
+    const auto load = std::get_if<op_load>(&prog.code[pos + 1]);
+    if (!load) return std::nullopt;
+    reg->size = load->size;
+    return std::pair{*reg, 2};
+}
+
+// A variable saved to by the two ops at pos
+auto write_register(const program& prog, const std::vector<bool>& targets, std::size_t pos)
+    -> std::optional<reg_operand>
+{
+    auto reg = address_register(prog.code[pos]);
+    if (!reg || pos + 1 >= prog.code.size() || targets[pos + 1]) return std::nullopt;
+    const auto save = std::get_if<op_save>(&prog.code[pos + 1]);
+    if (!save) return std::nullopt;
+    reg->size = save->size;
+    return reg;
+}
+
+}
+
+auto peephole(program& prog, const peephole_options& options) -> std::size_t
+{
+    const auto original_size = prog.code.size();
+
+    auto changed = true;
+    while (changed) {
+        changed = options.thread_jumps && thread_jumps(prog);
+
+        auto keep = std::vector<bool>(prog.code.size(), true);
+        if (simplify(prog, options, keep)) {
+            compact(prog, keep);
+            changed = true;
+        }
+    }
+
+    return original_size - prog.code.size();
+}
+
+auto select_register_ops(program& prog) -> std::size_t
+{
+    const auto original_size = prog.code.size();
+    const auto targets = find_targets(prog);
+    auto keep = std::vector<bool>(prog.code.size(), true);
+    auto& code = prog.code;
+
+    // Ops after the first in a sequence must not be jumped to
+    const auto can_fuse = [&](std::size_t pos) {
+        return pos < code.size() && !targets[pos];
+    };
+    const auto builtin_at = [&](std::size_t pos, std::size_t args_size) -> const op_builtin_call* {
+        if (!can_fuse(pos)) return nullptr;
+        const auto call = std::get_if<op_builtin_call>(&code[pos]);
+        return call && call->args_size == args_size ? call : nullptr;
+    };
+
+    // Replaces the ops in [begin, end) with the given op
+    const auto replace = [&](std::size_t begin, std::size_t end, auto&& new_op) {
+        code[begin].emplace<std::decay_t<decltype(new_op)>>(std::move(new_op));
+        for (auto pos = begin + 1; pos != end; ++pos) {
+            keep[pos] = false;
+        }
+    };
+
+    auto pos = std::size_t{0};
+    while (pos < code.size()) {
+        const auto first = read_register(prog, targets, pos);
+        if (!first) {
+            ++pos;
+            continue;
+        }
+        auto args = std::vector<reg_operand>{first->first};
+        auto next = pos + first->second;
+
+        // A unary or binary builtin, optionally followed by saving the result to a variable
+        auto call = builtin_at(next, args.front().size);
+        if (!call && can_fuse(next)) {
+            if (const auto second = read_register(prog, targets, next)) {
+                call = builtin_at(next + second->second, args.front().size + second->first.size);
+                if (call) {
+                    args.push_back(second->first);
+                    next += second->second;
+                }
+            }
+        }
+        if (call) {
+            auto end = next + 1;
+            auto dst = can_fuse(end) ? write_register(prog, targets, end) : std::nullopt;
+            if (dst && dst->size == call->return_size) {
+                end += 2;
+            } else {
+                dst.reset();
+            }
+            replace(pos, end, op_reg_call{
+                .name=call->name,
+                .ptr=call->ptr,
+                .args=std::move(args),
+                .return_size=call->return_size,
+                .dst=dst
+            });
+            pos = end;
+            continue;
+        }
+
+        // A copy into another variable, or a push of a variable
+        const auto dst = can_fuse(next) ? write_register(prog, targets, next) : std::nullopt;
+        if (dst && dst->size == first->first.size) {
+            replace(pos, next + 2, op_reg_move{ .src=first->first, .dst=dst });
+            pos = next + 2;
+        } else if (first->first.src != reg_operand::source::immediate) {
+            replace(pos, next, op_reg_move{ .src=first->first });
+            pos = next;
+        } else {
+            ++pos;
+        }
+    }
+
+    compact(prog, keep);
+    return original_size - prog.code.size();
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+#include "program.hpp"
+
+#include <cstddef>
+
+namespace anzu {
+
+struct peephole_options
+{
+    bool remove_pushed_pops  = true; // LOAD_BYTES(n) POP(n) -> nothing
+    bool thread_jumps        = true; // A jump to a jump goes straight to the final target
+    bool remove_empty_pops   = true; // POP(0) -> nothing
+    bool remove_zero_offsets = true; // LOAD_BYTES(0u) MODIFY_PTR -> nothing
+    bool merge_pops          = true; // POP(a) POP(b) -> POP(a + b)
+};
+
+// Rewrites short sequences of ops in the program into cheaper equivalents until no more can be
+// found, fixing up all jumps afterwards. Returns the number of ops removed.
+auto peephole(program& prog, const peephole_options& options = {}) -> std::size_t;
+
+// Rewrites variable accesses, and builtin calls whose args are variables or constants, into
+// register ops that read and write the variables in place rather than copying them through the
+// stack. Everything else is left for the stack machine. Returns the number of ops removed.
+auto select_register_ops(program& prog) -> std::size_t;
+
+}
\ No newline at end of file
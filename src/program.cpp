@@ -12,12 +12,36 @@ constexpr auto FORMAT3 = std::string_view{"{:<30} {:<20} {}"};
 
 }
 
+auto to_string(const reg_operand& operand) -> std::string
+{
+    switch (operand.src) {
+        case reg_operand::source::local: return std::format("r{}", operand.offset);
+        case reg_operand::source::global: return std::format("g{}", operand.offset);
+        default: return std::format("({})", format_comma_separated(operand.bytes));
+    }
+}
+
 auto to_string(const op& op_code) -> std::string
 {
     return std::visit(overloaded {
         [&](const op_load_bytes& op) {
             return std::format("LOAD_BYTES({})", format_comma_separated(op.bytes));
         },
+        [&](op_load_rom op) {
+            return std::format("LOAD_ROM({}, {})", op.position, op.size);
+        },
+        [&](op_push_rom_addr op) {
+            return std::format("PUSH_ROM_ADDR({})", op.position);
+        },
+        [&](op_repeat op) {
+            return std::format("REPEAT({}, {})", op.size, op.count);
+        },
+        [&](const op_soa_pack& op) {
+            return std::format(
+                "SOA_PACK({}, {}, [{}], [{}])", op.object_size, op.count,
+                format_comma_separated(op.field_offsets), format_comma_separated(op.field_sizes)
+            );
+        },
         [&](op_push_global_addr op) {
             return std::format("PUSH_GLOBAL_ADDR({})", op.position);
         },
@@ -27,6 +51,26 @@ auto to_string(const op& op_code) -> std::string
         [&](op_modify_ptr) {
             return std::string{"MODIFY_PTR"};
         },
+        [&](const op_index_addr& op) {
+            if (op.checked) {
+                return std::format("INDEX_ADDR_CHECKED({}, {})", op.elem_size, op.count);
+            }
+            return std::format("INDEX_ADDR({})", op.elem_size);
+        },
+        [&](op_slice_index_addr op) {
+            return std::format("SLICE_INDEX_ADDR{}({})", op.checked ? "_CHECKED" : "", op.elem_size);
+        },
+        [&](op_soa_slice_field_addr op) {
+            return std::format(
+                "SOA_SLICE_FIELD_ADDR{}({}, {})", op.checked ? "_CHECKED" : "", op.field_offset, op.field_size
+            );
+        },
+        [&](op_subslice op) {
+            return std::format("SUBSLICE{}({})", op.checked ? "_CHECKED" : "", op.elem_size);
+        },
+        [&](op_check_ptr op) {
+            return std::format("CHECK_PTR({})", op.size);
+        },
         [&](op_load op) {
             return std::format("LOAD({})", op.size);
         },
@@ -37,23 +81,53 @@ auto to_string(const op& op_code) -> std::string
             return std::format("POP({})", op.size);
         },
         [&](op_allocate op) {
-            return std::format("ALLOCATE({})", op.type_size);
+            return std::format("ALLOCATE({}, {}{})", op.type_size, op.alignment, op.as_slice ? ", slice" : "");
         },
         [&](op_deallocate op) {
             return std::string{"DEALLOCATE"};
         },
+        [&](op_vec_push op) {
+            return std::format("VEC_PUSH({})", op.elem_size);
+        },
+        [&](op_vec_pop op) {
+            return std::format("VEC_POP({})", op.elem_size);
+        },
+        [&](op_vec_index_addr op) {
+            return std::format("VEC_INDEX_ADDR({}{})", op.elem_size, op.checked ? ", checked" : "");
+        },
+        [&](op_vec_reserve op) {
+            return std::format("VEC_RESERVE({})", op.elem_size);
+        },
+        [&](op_vec_append op) {
+            return std::format("VEC_APPEND({})", op.elem_size);
+        },
+        [&](op_vec_copy op) {
+            return std::format("VEC_COPY({})", op.elem_size);
+        },
+        [&](op_vec_drop) {
+            return std::string{"VEC_DROP"};
+        },
+        [&](op_map_file op) {
+            return std::format("MAP_FILE({})", op.path_size);
+        },
         [&](op_jump op) {
             return std::format(FORMAT2, "JUMP_RELATIVE", op.jump);
         },
         [&](op_jump_if_false op) {
             return std::format(FORMAT2, "JUMP_RELATIVE_IF_FALSE", op.jump);
         },
+        [&](op_jump_if_true op) {
+            return std::format(FORMAT2, "JUMP_RELATIVE_IF_TRUE", op.jump);
+        },
         [&](const op_function& op) {
             const auto func_str = std::format("FUNCTION({})", op.name);
             const auto jump_str = std::format("JUMP -> {}", op.jump);
             return std::format(FORMAT2, func_str, jump_str);
         },
-        [&](op_return op) {
+        [&](const op_return& op) {
+            if (op.local) {
+                return std::format("RETURN_LOCAL({}, {})", op.size, *op.local);
+            }
             return std::format("RETURN({})", op.size);
         },
         [&](const op_function_call& op) {
@@ -61,9 +135,30 @@ auto to_string(const op& op_code) -> std::string
             const auto jump_str = std::format("JUMP -> {}", op.ptr);
             return std::format(FORMAT2, func_str, jump_str);
         },
+        [&](const op_tail_call& op) {
+            const auto func_str = std::format("TAIL_CALL({})", op.name);
+            const auto jump_str = std::format("JUMP -> {}", op.ptr);
+            return std::format(FORMAT2, func_str, jump_str);
+        },
+        [&](const op_memo_enter& op) {
+            return std::format("MEMO_ENTER({}, {})", op.name, op.args_size);
+        },
+        [&](const op_memo_store& op) {
+            return std::format("MEMO_STORE({})", op.result_size);
+        },
         [&](const op_builtin_call& op) {
             return std::format("BUILTIN_CALL({})", op.name);
         },
+        [&](const op_reg_move& op) {
+            const auto dst = op.dst ? to_string(*op.dst) : std::string{"push"};
+            return std::format(FORMAT2, "REG_MOVE", std::format("{} = {}", dst, to_string(op.src)));
+        },
+        [&](const op_reg_call& op) {
+            const auto dst = op.dst ? to_string(*op.dst) : std::string{"push"};
+            const auto args = format_comma_separated(op.args, [](const auto& arg) { return to_string(arg); });
+            const auto func_str = std::format("REG_CALL({})", op.name);
+            return std::format(FORMAT2, func_str, std::format("{} = {}", dst, args));
+        },
         [](const op_debug& op) {
             return std::format("DEBUG({})", op.message);
         }
@@ -73,9 +168,12 @@ auto to_string(const op& op_code) -> std::string
 auto print_program(const anzu::program& program) -> void
 {
     int lineno = 0;
-    for (const auto& op : program) {
+    for (const auto& op : program.code) {
         anzu::print("{:>4} - {}\n", lineno++, op);
     }
+    if (!program.rom.empty()) {
+        anzu::print("ROM: {} bytes\n", program.rom.size());
+    }
 }
 
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "operators.hpp"
 #include "object.hpp"
 
+#include <optional>
 #include <variant>
 #include <format>
 #include <vector>
@@ -17,6 +18,37 @@ struct op_load_bytes
     std::vector<std::byte> bytes;
 };
 
+// Pushes a copy of the given range of the program's read-only data segment.
+struct op_load_rom
+{
+    std::size_t position;
+    std::size_t size;
+};
+
+struct op_push_rom_addr
+{
+    std::size_t position;
+};
+
+// Duplicates the value of the given size on the top of the stack so that it appears count
+// times in a row.
+struct op_repeat
+{
+    std::size_t size;
+    std::size_t count;
+};
+
+// Rearranges the list of count objects on the top of the stack, each made up of fields at the
+// given offsets, so that the values of each field are contiguous. The column of each field
+// starts at its offset times the count.
+struct op_soa_pack
+{
+    std::size_t              object_size;
+    std::size_t              count;
+    std::vector<std::size_t> field_offsets;
+    std::vector<std::size_t> field_sizes;
+};
+
 struct op_push_global_addr
 {
     std::size_t position;
@@ -32,6 +64,49 @@ struct op_modify_ptr
 {
 };
 
+// Pops an index and a pointer to the start of a list of the given count, and pushes a pointer
+// to the element at that index. If checked, the index is checked against the count.
+struct op_index_addr
+{
+    std::size_t elem_size;
+    std::size_t count;
+    bool        checked;
+};
+
+// Pops an index and a slice, and pushes a pointer to the element at that index. If checked, the
+// index is checked against the size of the slice.
+struct op_slice_index_addr
+{
+    std::size_t elem_size;
+    bool        checked;
+};
+
+// Pops an index and a slice of an soa type, and pushes a pointer to the given field of the
+// element at that index. Each field has a column as long as the slice, so the column starts at
+// the offset of the field times the size. If checked, the index is checked against the size.
+struct op_soa_slice_field_addr
+{
+    std::size_t field_offset;
+    std::size_t field_size;
+    bool        checked;
+};
+
+// Pops an upper and lower bound and a slice, and pushes the slice of the elements from the lower
+// bound up to but not including the upper bound. If checked, the bounds are checked against the
+// size of the slice.
+struct op_subslice
+{
+    std::size_t elem_size;
+    bool        checked;
+};
+
+// Checks that the pointer on the top of the stack points to the given number of bytes of valid
+// memory, leaving the pointer on the stack.
+struct op_check_ptr
+{
+    std::size_t size;
+};
+
 struct op_load
 {
     std::size_t size;
@@ -47,15 +122,69 @@ struct op_pop
     std::size_t size;
 };
 
+// Blocks are padded to a multiple of the alignment, so that if every block in the program
+// uses the same alignment, they all start at aligned addresses. If as_slice is set, the count
+// is pushed after the pointer, making a slice of the new elements.
 struct op_allocate
 {
     std::size_t type_size;
+    std::size_t alignment = 1;
+    bool        as_slice  = false;
+};
+
+// Operations on vecs, which take a pointer to the vec. These allocate from the heap as the
+// vec grows, and push and reserve return null.
+struct op_vec_push
+{
+    std::size_t elem_size;
+};
+
+struct op_vec_pop
+{
+    std::size_t elem_size;
+};
+
+struct op_vec_index_addr
+{
+    std::size_t elem_size;
+    bool        checked;
+};
+
+struct op_vec_reserve
+{
+    std::size_t elem_size;
+};
+
+// Appends the elements of the slice on the top of the stack
+struct op_vec_append
+{
+    std::size_t elem_size;
+};
+
+struct op_vec_drop
+{
+};
+
+// Replaces the vec value on the top of the stack with a copy that has its own elements, so
+// that both can be dropped
+struct op_vec_copy
+{
+    std::size_t elem_size;
 };
 
 struct op_deallocate
 {
 };
 
+// Pops a file path of the given length from the stack, maps the file into memory as read-only
+// and pushes a pointer to the start of it followed by its size in bytes. Relative paths are
+// resolved against the directory of the source file.
+struct op_map_file
+{
+    std::size_t path_size;
+    std::string source_dir;
+};
+
 struct op_jump
 {
     std::int64_t jump;
@@ -66,11 +195,46 @@ struct op_jump_if_false
     std::size_t jump;
 };
 
+struct op_jump_if_true
+{
+    std::int64_t jump;
+};
+
 struct op_function_call
 {
     std::string name;
     std::size_t ptr;
     std::size_t args_size;
+    std::size_t return_size;
+};
+
+// Calls a function by reusing the current frame. The args for the new call are on the top of
+// the stack, they are moved down to replace the args of the current function, keeping its saved
+// base and program pointers so that the callee returns directly to the current caller.
+struct op_tail_call
+{
+    std::string name;
+    std::size_t ptr;
+    std::size_t args_size;
+    std::size_t return_size;
+};
+
+// Looks up the args of the current call in the cache of a memoised function. On a hit the
+// cached result is returned immediately, otherwise the args are kept until the matching
+// op_memo_store.
+struct op_memo_enter
+{
+    std::string name;
+    std::size_t id;
+    std::size_t args_size;
+};
+
+// Stores the result on the top of the stack in the cache of a memoised function, keyed by the
+// args kept by the matching op_memo_enter.
+struct op_memo_store
+{
+    std::size_t id;
+    std::size_t result_size;
 };
 
 struct op_builtin_call
@@ -78,17 +242,53 @@ struct op_builtin_call
     std::string      name;
     builtin_function ptr;
     std::size_t      args_size;
+    std::size_t      return_size;
+};
+
+// An operand of a register op. Variables are used as registers directly, named by their offset
+// in the current frame or their position in the globals. Small constants are stored in the op.
+struct reg_operand
+{
+    enum class source { local, global, immediate };
+
+    source                 src;
+    std::size_t            offset = 0; // Unused for immediates
+    std::size_t            size   = 0;
+    std::vector<std::byte> bytes;      // Only used for immediates
+};
+
+// Copies src into dst, or pushes it if there is no dst. Replaces the PUSH_LOCAL_ADDR and LOAD
+// or SAVE ops of a variable access.
+struct op_reg_move
+{
+    reg_operand                src;
+    std::optional<reg_operand> dst;
+};
+
+// Calls a builtin with args read from registers and stores the result in dst, or pushes it if
+// there is no dst. As with SAVE, storing to the top of the stack declares a new variable.
+struct op_reg_call
+{
+    std::string                name;
+    builtin_function           ptr;
+    std::vector<reg_operand>   args;
+    std::size_t                return_size;
+    std::optional<reg_operand> dst;
 };
 
 struct op_function
 {
     std::string name;
     std::size_t jump;
+    std::size_t args_size; // Includes the saved base and program ptrs
 };
 
+// Returns the value on the top of the stack to the caller. If a local is set, the value is
+// copied straight from that local variable instead, which saves pushing a copy of it first.
 struct op_return
 {
-    std::size_t size;
+    std::size_t                size;
+    std::optional<std::size_t> local;
 };
 
 struct op_debug
@@ -98,26 +298,61 @@ struct op_debug
 
 struct op : std::variant<
     op_load_bytes,
+    op_load_rom,
+    op_push_rom_addr,
+    op_repeat,
+    op_soa_pack,
     op_push_global_addr,
     op_push_local_addr,
     op_modify_ptr,
+    op_index_addr,
+    op_slice_index_addr,
+    op_soa_slice_field_addr,
+    op_subslice,
+    op_check_ptr,
     op_load,
     op_save,
     op_pop,
     op_allocate,
     op_deallocate,
+    op_vec_push,
+    op_vec_pop,
+    op_vec_index_addr,
+    op_vec_reserve,
+    op_vec_append,
+    op_vec_drop,
+    op_vec_copy,
+    op_map_file,
     op_jump,
     op_jump_if_false,
+    op_jump_if_true,
     op_function,
     op_return,
     op_function_call,
+    op_tail_call,
+    op_memo_enter,
+    op_memo_store,
     op_builtin_call,
+    op_reg_move,
+    op_reg_call,
     op_debug
 >
 {};
 
-using program = std::vector<op>;
+struct program
+{
+    std::vector<op>        code;
+    std::vector<std::byte> rom; // Read-only data segment for large constants and embeds
+
+    // Stack frames start at a multiple of this, which is 16 in the aligned layout
+    std::size_t frame_alignment = 1;
+
+    // Set if the program checks pointers, which needs the runtime to record every live heap
+    // allocation
+    bool track_allocations = false;
+};
 
+auto to_string(const reg_operand& operand) -> std::string;
 auto to_string(const op& op_code) -> std::string;
 auto print_program(const anzu::program& program) -> void;
 
@@ -4,8 +4,11 @@
 #include "utility/overloaded.hpp"
 #include "utility/scope_timer.hpp"
 #include "utility/memory.hpp"
+#include "utility/views.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <filesystem>
 #include <utility>
 
 namespace anzu {
@@ -31,15 +34,192 @@ auto get_top_bit(std::uint64_t x) -> bool
     return x & top_bit;
 }
 
+// Pointers into read-only memory have the second highest bit set, followed by the index of the
+// region, and the offset into the region in the lowest 40 bits.
+constexpr auto read_only_bit = std::uint64_t{1} << 62;
+constexpr auto read_only_offset_bits = 40;
+constexpr auto read_only_offset_mask = (std::uint64_t{1} << read_only_offset_bits) - 1;
+
+auto make_read_only_ptr(std::size_t region, std::size_t offset) -> std::uint64_t
+{
+    return read_only_bit | (region << read_only_offset_bits) | offset;
+}
+
+auto is_read_only_ptr(std::uint64_t x) -> bool
+{
+    return !get_top_bit(x) && (x & read_only_bit);
+}
+
+auto read_only_region(const runtime_context& ctx, std::uint64_t x) -> std::span<const std::byte>
+{
+    const auto region = (x & ~read_only_bit) >> read_only_offset_bits;
+    if (region == 0) {
+        return ctx.rom;
+    }
+    const auto& file = *ctx.mapped_files[region - 1];
+    return {file.data(), file.size()};
+}
+
+auto read_only_offset(std::uint64_t x) -> std::size_t
+{
+    return x & read_only_offset_mask;
+}
+
+auto reg_address(const runtime_context& ctx, const reg_operand& reg) -> std::size_t
+{
+    return reg.src == reg_operand::source::local ? ctx.base_ptr + reg.offset : reg.offset;
+}
+
+auto push_reg(runtime_context& ctx, const reg_operand& reg) -> void
+{
+    if (reg.src == reg_operand::source::immediate) {
+        ctx.stack.insert(ctx.stack.end(), reg.bytes.begin(), reg.bytes.end());
+        return;
+    }
+    const auto top = ctx.stack.size();
+    ctx.stack.resize(top + reg.size);
+    std::memcpy(&ctx.stack[top], &ctx.stack[reg_address(ctx, reg)], reg.size);
+}
+
+// Moves the value on the top of the stack into the register. If the register is the top of the
+// stack, the value stays where it is as a new variable.
+auto pop_into_reg(runtime_context& ctx, const reg_operand& reg) -> void
+{
+    const auto value = ctx.stack.size() - reg.size;
+    const auto addr = reg_address(ctx, reg);
+    if (addr != value) {
+        std::memcpy(&ctx.stack[addr], &ctx.stack[value], reg.size);
+        ctx.stack.resize(value);
+    }
+}
+
+// Returns true if the given number of bytes at the pointer are within the stack, a live heap
+// allocation or a read-only region.
+auto is_valid_ptr(const runtime_context& ctx, std::uint64_t ptr, std::size_t size) -> bool
+{
+    if (get_top_bit(ptr)) {
+        const auto heap_ptr = unset_top_bit(ptr);
+        auto it = ctx.allocations.upper_bound(heap_ptr);
+        if (it == ctx.allocations.begin()) return false;
+        --it;
+        return heap_ptr + size <= it->first + it->second;
+    }
+    if (is_read_only_ptr(ptr)) {
+        return read_only_offset(ptr) + size <= read_only_region(ctx, ptr).size();
+    }
+    return ptr + size <= ctx.stack.size();
+}
+
+constexpr auto memo_cache_capacity = std::size_t{4096};
+
+// Evaluation at compile time gives up if the stack grows past this many bytes, such as from deep
+// recursion.
+constexpr auto evaluation_stack_limit = std::size_t{1024 * 1024};
+
+auto print_memo_stats(const runtime_context& ctx) -> void
+{
+    for (const auto& cache : ctx.memo_caches) {
+        if (cache.hits + cache.misses > 0) {
+            anzu::print(
+                "\n -> Memo '{}': {} hits, {} misses, {} evictions\n",
+                cache.name, cache.hits, cache.misses, cache.evictions
+            );
+        }
+    }
+}
+
 }
 
 template <typename ...Args>
 auto runtime_assert(bool condition, std::string_view msg, Args&&... args)
 {
     if (!condition) {
-        anzu::print(msg, std::forward<Args>(args)...);
-        std::exit(1);
+        throw runtime_error{std::format(msg, std::forward<Args>(args)...)};
+    }
+}
+
+namespace {
+
+// Allocates a block of at least the given size, padded to a multiple of the alignment. The size
+// of the block is stored before it so that it can be freed.
+auto heap_allocate(runtime_context& ctx, std::size_t size, std::size_t alignment) -> std::uint64_t
+{
+    const auto block_size = align_up(size, alignment);
+    const auto ptr = ctx.allocator.allocate(block_size + sizeof(std::uint64_t));
+    write_value(ctx.heap, ptr, block_size); // Store the size at the pointer
+    if (ctx.track_allocations) {
+        ctx.allocations.emplace(ptr + sizeof(std::uint64_t), size);
     }
+    return set_top_bit(ptr + sizeof(std::uint64_t)); // Return pointer past the size
+}
+
+auto heap_deallocate(runtime_context& ctx, std::uint64_t ptr) -> void
+{
+    runtime_assert(get_top_bit(ptr), "cannot delete a pointer to stack memory\n");
+    const auto heap_ptr = unset_top_bit(ptr) - sizeof(std::uint64_t);
+    const auto size = read_value<std::uint64_t>(ctx.heap, heap_ptr);
+    ctx.allocator.deallocate(heap_ptr, size + sizeof(std::uint64_t));
+    if (ctx.track_allocations) {
+        ctx.allocations.erase(heap_ptr + sizeof(std::uint64_t));
+    }
+}
+
+// Copies the bytes at the pointer, which may be into the stack, the heap or read-only memory
+auto read_bytes(const runtime_context& ctx, std::uint64_t ptr, std::size_t size) -> std::vector<std::byte>
+{
+    if (get_top_bit(ptr)) {
+        const auto begin = ctx.heap.begin() + unset_top_bit(ptr);
+        return {begin, begin + size};
+    }
+    if (is_read_only_ptr(ptr)) {
+        const auto begin = read_only_region(ctx, ptr).begin() + read_only_offset(ptr);
+        return {begin, begin + size};
+    }
+    const auto begin = ctx.stack.begin() + ptr;
+    return {begin, begin + size};
+}
+
+auto writable_memory(runtime_context& ctx, std::uint64_t ptr) -> std::byte*
+{
+    runtime_assert(!is_read_only_ptr(ptr), "cannot write to read-only memory\n");
+    return get_top_bit(ptr) ? &ctx.heap[unset_top_bit(ptr)] : &ctx.stack[ptr];
+}
+
+// The layout of a vec, the handle is stored wherever the vec is and the elements on the heap
+struct vec_handle
+{
+    std::uint64_t data     = 0;
+    std::uint64_t size     = 0;
+    std::uint64_t capacity = 0;
+};
+
+auto read_vec(runtime_context& ctx, std::uint64_t ptr) -> vec_handle
+{
+    auto vec = vec_handle{};
+    std::memcpy(&vec, writable_memory(ctx, ptr), sizeof(vec));
+    return vec;
+}
+
+auto write_vec(runtime_context& ctx, std::uint64_t ptr, const vec_handle& vec) -> void
+{
+    std::memcpy(writable_memory(ctx, ptr), &vec, sizeof(vec));
+}
+
+// Moves the elements into a new block with space for at least the given number of elements.
+// Blocks are a multiple of 8 bytes so that they keep the heap aligned in the aligned layout.
+auto reserve_vec(runtime_context& ctx, vec_handle& vec, std::size_t capacity, std::size_t elem_size) -> void
+{
+    if (capacity <= vec.capacity) return;
+    const auto size = align_up(capacity * elem_size, sizeof(std::uint64_t));
+    const auto data = heap_allocate(ctx, size, 1);
+    if (vec.capacity > 0) {
+        std::memcpy(&ctx.heap[unset_top_bit(data)], &ctx.heap[unset_top_bit(vec.data)], vec.size * elem_size);
+        heap_deallocate(ctx, vec.data);
+    }
+    vec.data = data;
+    vec.capacity = size / elem_size;
+}
+
 }
 
 auto apply_op(runtime_context& ctx, const op& op_code) -> void
@@ -51,6 +231,34 @@ auto apply_op(runtime_context& ctx, const op& op_code) -> void
             }
             ++ctx.prog_ptr;
         },
+        [&](op_load_rom op) {
+            const auto begin = ctx.rom.begin() + op.position;
+            ctx.stack.insert(ctx.stack.end(), begin, begin + op.size);
+            ++ctx.prog_ptr;
+        },
+        [&](op_push_rom_addr op) {
+            push_value(ctx.stack, make_read_only_ptr(0, op.position));
+            ++ctx.prog_ptr;
+        },
+        [&](op_repeat op) {
+            const auto begin = ctx.stack.size() - op.size;
+            ctx.stack.resize(begin + op.size * op.count);
+            for (std::size_t i = 1; i < op.count; ++i) {
+                std::memcpy(&ctx.stack[begin + i * op.size], &ctx.stack[begin], op.size);
+            }
+            ++ctx.prog_ptr;
+        },
+        [&](const op_soa_pack& op) {
+            const auto begin = ctx.stack.size() - op.object_size * op.count;
+            const auto objects = std::vector<std::byte>(ctx.stack.begin() + begin, ctx.stack.end());
+            for (const auto& [offset, size] : zip(op.field_offsets, op.field_sizes)) {
+                const auto column = begin + offset * op.count;
+                for (std::size_t i = 0; i != op.count; ++i) {
+                    std::memcpy(&ctx.stack[column + i * size], &objects[i * op.object_size + offset], size);
+                }
+            }
+            ++ctx.prog_ptr;
+        },
         [&](op_push_global_addr op) {
             push_value(ctx.stack, op.position);
             ++ctx.prog_ptr;
@@ -65,14 +273,68 @@ auto apply_op(runtime_context& ctx, const op& op_code) -> void
             push_value(ctx.stack, ptr + offset);
             ++ctx.prog_ptr;
         },
+        [&](const op_index_addr& op) {
+            const auto index = pop_value<std::uint64_t>(ctx.stack);
+            if (op.checked || ctx.check_all) {
+                runtime_assert(index < op.count, "index {} out of range for list of size {}\n", index, op.count);
+            }
+            const auto ptr = pop_value<std::uint64_t>(ctx.stack);
+            push_value(ctx.stack, ptr + index * op.elem_size);
+            ++ctx.prog_ptr;
+        },
+        [&](op_slice_index_addr op) {
+            const auto index = pop_value<std::uint64_t>(ctx.stack);
+            const auto size = pop_value<std::uint64_t>(ctx.stack);
+            if (op.checked || ctx.check_all) {
+                runtime_assert(index < size, "index {} out of range for slice of size {}\n", index, size);
+            }
+            const auto ptr = pop_value<std::uint64_t>(ctx.stack);
+            push_value(ctx.stack, ptr + index * op.elem_size);
+            ++ctx.prog_ptr;
+        },
+        [&](op_soa_slice_field_addr op) {
+            const auto index = pop_value<std::uint64_t>(ctx.stack);
+            const auto size = pop_value<std::uint64_t>(ctx.stack);
+            if (op.checked || ctx.check_all) {
+                runtime_assert(index < size, "index {} out of range for slice of size {}\n", index, size);
+            }
+            const auto ptr = pop_value<std::uint64_t>(ctx.stack);
+            push_value(ctx.stack, ptr + op.field_offset * size + index * op.field_size);
+            ++ctx.prog_ptr;
+        },
+        [&](op_subslice op) {
+            const auto upper = pop_value<std::uint64_t>(ctx.stack);
+            const auto lower = pop_value<std::uint64_t>(ctx.stack);
+            const auto size = pop_value<std::uint64_t>(ctx.stack);
+            if (op.checked || ctx.check_all) {
+                runtime_assert(lower <= upper && upper <= size, "slice [{}:{}] out of range for slice of size {}\n", lower, upper, size);
+            }
+            const auto ptr = pop_value<std::uint64_t>(ctx.stack);
+            push_value(ctx.stack, ptr + lower * op.elem_size);
+            push_value(ctx.stack, upper - lower);
+            ++ctx.prog_ptr;
+        },
+        [&](op_check_ptr op) {
+            const auto ptr = read_value<std::uint64_t>(ctx.stack, ctx.stack.size() - sizeof(std::uint64_t));
+            runtime_assert(is_valid_ptr(ctx, ptr, op.size), "invalid access of {} bytes at pointer {:#x}\n", op.size, ptr);
+            ++ctx.prog_ptr;
+        },
         [&](op_load op) {
             const auto ptr = pop_value<std::uint64_t>(ctx.stack);
-            
+            if (ctx.check_all) {
+                runtime_assert(is_valid_ptr(ctx, ptr, op.size), "invalid access of {} bytes at pointer {:#x}\n", op.size, ptr);
+            }
+
             if (get_top_bit(ptr)) {
                 const auto heap_ptr = unset_top_bit(ptr);
                 for (std::size_t i = 0; i != op.size; ++i) {
                     ctx.stack.push_back(ctx.heap[heap_ptr + i]);
                 }
+            } else if (is_read_only_ptr(ptr)) {
+                const auto region = read_only_region(ctx, ptr);
+                const auto offset = read_only_offset(ptr);
+                runtime_assert(offset + op.size <= region.size(), "tried to read past the end of read-only memory\n");
+                ctx.stack.insert(ctx.stack.end(), region.data() + offset, region.data() + offset + op.size);
             } else {
                 for (std::size_t i = 0; i != op.size; ++i) {
                     ctx.stack.push_back(ctx.stack[ptr + i]);
@@ -83,6 +345,10 @@ auto apply_op(runtime_context& ctx, const op& op_code) -> void
         },
         [&](op_save op) {
             const auto ptr = pop_value<std::uint64_t>(ctx.stack);
+            runtime_assert(!is_read_only_ptr(ptr), "cannot write to read-only memory\n");
+            if (ctx.check_all) {
+                runtime_assert(is_valid_ptr(ctx, ptr, op.size), "invalid access of {} bytes at pointer {:#x}\n", op.size, ptr);
+            }
 
             if (get_top_bit(ptr)) {
                 const auto heap_ptr = unset_top_bit(ptr);
@@ -105,17 +371,110 @@ auto apply_op(runtime_context& ctx, const op& op_code) -> void
         },
         [&](op_allocate op) {
             const auto count = pop_value<std::uint64_t>(ctx.stack);
-            const auto ptr = ctx.allocator.allocate(count * op.type_size + sizeof(std::uint64_t));
-            write_value(ctx.heap, ptr, count * op.type_size); // Store the size at the pointer
-            push_value(ctx.stack, set_top_bit(ptr + sizeof(std::uint64_t))); // Return pointer past the size
+            push_value(ctx.stack, heap_allocate(ctx, count * op.type_size, op.alignment));
+            if (op.as_slice) {
+                push_value(ctx.stack, count);
+            }
             ++ctx.prog_ptr;
         },
         [&](op_deallocate) {
+            heap_deallocate(ctx, pop_value<std::uint64_t>(ctx.stack));
+            ++ctx.prog_ptr;
+        },
+        [&](op_vec_push op) {
+            const auto value = ctx.stack.size() - op.elem_size;
+            const auto ptr = read_value<std::uint64_t>(ctx.stack, value - sizeof(std::uint64_t));
+            auto vec = read_vec(ctx, ptr);
+            if (vec.size == vec.capacity) {
+                reserve_vec(ctx, vec, std::max(2 * vec.capacity, std::uint64_t{1}), op.elem_size);
+            }
+            std::memcpy(&ctx.heap[unset_top_bit(vec.data) + vec.size * op.elem_size], &ctx.stack[value], op.elem_size);
+            ++vec.size;
+            write_vec(ctx, ptr, vec);
+            pop_n(ctx.stack, op.elem_size + sizeof(std::uint64_t));
+            ctx.stack.push_back(std::byte{0}); // Return null
+            ++ctx.prog_ptr;
+        },
+        [&](op_vec_pop op) {
+            const auto ptr = pop_value<std::uint64_t>(ctx.stack);
+            auto vec = read_vec(ctx, ptr);
+            runtime_assert(vec.size > 0, "cannot pop from an empty vec\n");
+            --vec.size;
+            write_vec(ctx, ptr, vec);
+            const auto begin = ctx.heap.begin() + unset_top_bit(vec.data) + vec.size * op.elem_size;
+            ctx.stack.insert(ctx.stack.end(), begin, begin + op.elem_size);
+            ++ctx.prog_ptr;
+        },
+        [&](op_vec_index_addr op) {
+            const auto index = pop_value<std::uint64_t>(ctx.stack);
+            const auto vec = read_vec(ctx, pop_value<std::uint64_t>(ctx.stack));
+            if (op.checked || ctx.check_all) {
+                runtime_assert(index < vec.size, "index {} out of range for vec of size {}\n", index, vec.size);
+            }
+            push_value(ctx.stack, vec.data + index * op.elem_size);
+            ++ctx.prog_ptr;
+        },
+        [&](op_vec_reserve op) {
+            const auto capacity = pop_value<std::uint64_t>(ctx.stack);
+            const auto ptr = pop_value<std::uint64_t>(ctx.stack);
+            auto vec = read_vec(ctx, ptr);
+            reserve_vec(ctx, vec, capacity, op.elem_size);
+            write_vec(ctx, ptr, vec);
+            ctx.stack.push_back(std::byte{0}); // Return null
+            ++ctx.prog_ptr;
+        },
+        [&](op_vec_append op) {
+            const auto count = pop_value<std::uint64_t>(ctx.stack);
+            const auto data = pop_value<std::uint64_t>(ctx.stack);
+            const auto ptr = pop_value<std::uint64_t>(ctx.stack);
+
+            // Copied first, since the elements may be in this vec and be moved when it grows
+            const auto elements = read_bytes(ctx, data, count * op.elem_size);
+            auto vec = read_vec(ctx, ptr);
+            if (vec.size + count > vec.capacity) {
+                reserve_vec(ctx, vec, std::max(vec.size + count, 2 * vec.capacity), op.elem_size);
+            }
+            if (!elements.empty()) {
+                std::memcpy(&ctx.heap[unset_top_bit(vec.data) + vec.size * op.elem_size], elements.data(), elements.size());
+            }
+            vec.size += count;
+            write_vec(ctx, ptr, vec);
+            ctx.stack.push_back(std::byte{0}); // Return null
+            ++ctx.prog_ptr;
+        },
+        [&](op_vec_copy op) {
+            const auto top = ctx.stack.size() - sizeof(vec_handle);
+            const auto vec = read_value<vec_handle>(ctx.stack, top);
+            auto copy = vec_handle{};
+            reserve_vec(ctx, copy, vec.size, op.elem_size);
+            if (vec.size > 0) {
+                std::memcpy(&ctx.heap[unset_top_bit(copy.data)], &ctx.heap[unset_top_bit(vec.data)], vec.size * op.elem_size);
+            }
+            copy.size = vec.size;
+            write_value(ctx.stack, top, copy);
+            ++ctx.prog_ptr;
+        },
+        [&](op_vec_drop) {
             const auto ptr = pop_value<std::uint64_t>(ctx.stack);
-            runtime_assert(get_top_bit(ptr), "cannot delete a pointer to stack memory\n");
-            const auto heap_ptr = unset_top_bit(ptr) - sizeof(std::uint64_t);
-            const auto size = read_value<std::uint64_t>(ctx.heap, heap_ptr);
-            ctx.allocator.deallocate(heap_ptr, size + sizeof(std::uint64_t));
+            const auto vec = read_vec(ctx, ptr);
+            if (vec.capacity > 0) {
+                heap_deallocate(ctx, vec.data);
+            }
+            write_vec(ctx, ptr, vec_handle{});
+            ++ctx.prog_ptr;
+        },
+        [&](op_map_file op) {
+            const auto path_begin = reinterpret_cast<const char*>(&ctx.stack[ctx.stack.size() - op.path_size]);
+            const auto path = std::string(path_begin, op.path_size);
+            pop_n(ctx.stack, op.path_size);
+
+            auto file = std::make_unique<mapped_file>((std::filesystem::path{op.source_dir} / path).string());
+            runtime_assert(file->valid(), "could not read file '{}'\n", path);
+            runtime_assert(file->size() <= read_only_offset_mask, "file '{}' is too large to map\n", path);
+
+            push_value(ctx.stack, make_read_only_ptr(ctx.mapped_files.size() + 1, 0));
+            push_value(ctx.stack, file->size());
+            ctx.mapped_files.push_back(std::move(file));
             ++ctx.prog_ptr;
         },
         [&](op_jump op) {
@@ -128,32 +487,122 @@ auto apply_op(runtime_context& ctx, const op& op_code) -> void
                 ctx.prog_ptr += op.jump;
             }
         },
+        [&](op_jump_if_true op) {
+            if (pop_value<bool>(ctx.stack)) {
+                ctx.prog_ptr += op.jump;
+            } else {
+                ++ctx.prog_ptr;
+            }
+        },
         [&](const op_function& op) {
             ctx.prog_ptr = op.jump;
         },
-        [&](op_return op) {
-            const auto prev_base_ptr = read_value<std::uint64_t>(ctx.stack, ctx.base_ptr);
+        [&](const op_return& op) {
+            const auto saved_base_ptr = read_value<std::uint64_t>(ctx.stack, ctx.base_ptr);
             const auto prev_prog_ptr = read_value<std::uint64_t>(ctx.stack, ctx.base_ptr + sizeof(std::uint64_t));
+            const auto padding = saved_base_ptr & (ctx.frame_alignment - 1);
+            const auto frame_begin = ctx.base_ptr - padding;
             
-            std::memcpy(&ctx.stack[ctx.base_ptr], &ctx.stack[ctx.stack.size() - op.size], op.size);
-            ctx.stack.resize(ctx.base_ptr + op.size);
-            ctx.base_ptr = prev_base_ptr;
+            // The value may overlap the frame header if the function has few args and locals
+            const auto src = op.local ? ctx.base_ptr + *op.local : ctx.stack.size() - op.size;
+            std::memmove(&ctx.stack[frame_begin], &ctx.stack[src], op.size);
+            ctx.stack.resize(frame_begin + op.size);
+            ctx.base_ptr = saved_base_ptr - padding;
             ctx.prog_ptr = prev_prog_ptr;
         },
         [&](const op_function_call& op) {
             // Store the old base_ptr and prog_ptr so that they can be restored at the end of
             // the function.
-            const auto new_base_ptr = ctx.stack.size() - op.args_size;
-            write_value(ctx.stack, new_base_ptr, ctx.base_ptr);
+            auto new_base_ptr = ctx.stack.size() - op.args_size;
+
+            // The args are moved up to start the frame at an aligned position
+            const auto padding = (ctx.frame_alignment - new_base_ptr) & (ctx.frame_alignment - 1);
+            if (padding > 0) {
+                ctx.stack.insert(ctx.stack.begin() + new_base_ptr, padding, std::byte{0});
+                new_base_ptr += padding;
+            }
+            write_value(ctx.stack, new_base_ptr, ctx.base_ptr + padding);
             write_value(ctx.stack, new_base_ptr + sizeof(std::uint64_t), ctx.prog_ptr + 1); // Pos after function call
             
             ctx.base_ptr = new_base_ptr;
             ctx.prog_ptr = op.ptr; // Jump into the function
         },
+        [&](const op_tail_call& op) {
+            const auto payload_size = 2 * sizeof(std::uint64_t);
+            const auto args_begin = ctx.stack.size() - op.args_size + payload_size;
+            std::memmove(
+                &ctx.stack[ctx.base_ptr + payload_size],
+                &ctx.stack[args_begin],
+                op.args_size - payload_size
+            );
+            ctx.stack.resize(ctx.base_ptr + op.args_size);
+            ctx.prog_ptr = op.ptr; // Jump into the function
+        },
+        [&](const op_memo_enter& op) {
+            if (ctx.memo_caches.size() <= op.id) {
+                ctx.memo_caches.resize(op.id + 1);
+            }
+            auto& cache = ctx.memo_caches[op.id];
+            cache.name = op.name;
+
+            const auto args_begin = ctx.base_ptr + 2 * sizeof(std::uint64_t);
+            auto key = std::string(reinterpret_cast<const char*>(ctx.stack.data() + args_begin), op.args_size);
+            if (const auto it = cache.results.find(key); it != cache.results.end()) {
+                ++cache.hits;
+                const auto saved_base_ptr = read_value<std::uint64_t>(ctx.stack, ctx.base_ptr);
+                const auto prev_prog_ptr = read_value<std::uint64_t>(ctx.stack, ctx.base_ptr + sizeof(std::uint64_t));
+                const auto padding = saved_base_ptr & (ctx.frame_alignment - 1);
+                ctx.stack.resize(ctx.base_ptr - padding);
+                ctx.stack.insert(ctx.stack.end(), it->second.begin(), it->second.end());
+                ctx.base_ptr = saved_base_ptr - padding;
+                ctx.prog_ptr = prev_prog_ptr;
+            } else {
+                ++cache.misses;
+                ctx.memo_keys.push_back(std::move(key));
+                ++ctx.prog_ptr;
+            }
+        },
+        [&](const op_memo_store& op) {
+            auto& cache = ctx.memo_caches[op.id];
+            auto key = std::move(ctx.memo_keys.back());
+            ctx.memo_keys.pop_back();
+
+            if (!cache.results.contains(key)) {
+                if (cache.results.size() == memo_cache_capacity) {
+                    cache.results.erase(cache.order.front());
+                    cache.order.pop_front();
+                    ++cache.evictions;
+                }
+                const auto result_begin = ctx.stack.end() - op.result_size;
+                cache.order.push_back(key);
+                cache.results.emplace(std::move(key), std::vector<std::byte>(result_begin, ctx.stack.end()));
+            }
+            ++ctx.prog_ptr;
+        },
         [&](const op_builtin_call& op) {
             op.ptr(ctx.stack);
             ++ctx.prog_ptr;
         },
+        [&](const op_reg_move& op) {
+            if (!op.dst || reg_address(ctx, *op.dst) == ctx.stack.size()) {
+                push_reg(ctx, op.src);
+            } else if (op.src.src == reg_operand::source::immediate) {
+                std::memcpy(&ctx.stack[reg_address(ctx, *op.dst)], op.src.bytes.data(), op.src.size);
+            } else {
+                std::memmove(&ctx.stack[reg_address(ctx, *op.dst)], &ctx.stack[reg_address(ctx, op.src)], op.src.size);
+            }
+            ++ctx.prog_ptr;
+        },
+        [&](const op_reg_call& op) {
+            for (const auto& arg : op.args) {
+                push_reg(ctx, arg);
+            }
+            op.ptr(ctx.stack);
+            if (op.dst) {
+                pop_into_reg(ctx, *op.dst);
+            }
+            ++ctx.prog_ptr;
+        },
         [&](const op_debug& op) {
             print(op.message);
             ++ctx.prog_ptr;
@@ -166,28 +615,70 @@ auto run_program(const anzu::program& program) -> void
     const auto timer = scope_timer{};
 
     runtime_context ctx;
-    while (ctx.prog_ptr < program.size()) {
-        apply_op(ctx, program[ctx.prog_ptr]);
+    ctx.rom = program.rom;
+    ctx.frame_alignment = program.frame_alignment;
+    ctx.track_allocations = program.track_allocations;
+    try {
+        while (ctx.prog_ptr < program.code.size()) {
+            apply_op(ctx, program.code[ctx.prog_ptr]);
+        }
+    } catch (const runtime_error& e) {
+        anzu::print("{}", e.what());
+        std::exit(1);
     }
 
+    print_memo_stats(ctx);
+
     if (ctx.allocator.bytes_allocated() > 0) {
         anzu::print("\n -> Heap Size: {}, fix your memory leak!\n", ctx.allocator.bytes_allocated());
     }
 }
 
+auto evaluate(const anzu::program& program, std::size_t start, std::size_t step_budget)
+    -> std::optional<std::vector<std::byte>>
+{
+    runtime_context ctx;
+    ctx.rom = program.rom;
+    ctx.frame_alignment = program.frame_alignment;
+    ctx.prog_ptr = start;
+    ctx.check_all = true;
+    ctx.track_allocations = true;
+    try {
+        for (std::size_t step = 0; ctx.prog_ptr < program.code.size(); ++step) {
+            if (step == step_budget || ctx.stack.size() > evaluation_stack_limit) {
+                return std::nullopt;
+            }
+            apply_op(ctx, program.code[ctx.prog_ptr]);
+        }
+    } catch (const runtime_error&) {
+        return std::nullopt;
+    }
+    return ctx.stack;
+}
+
 auto run_program_debug(const anzu::program& program) -> void
 {
     const auto timer = scope_timer{};
 
     runtime_context ctx;
-    while (ctx.prog_ptr < program.size()) {
-        const auto& op = program[ctx.prog_ptr];
-        anzu::print("{:>4} - {}\n", ctx.prog_ptr, op);
-        apply_op(ctx, program[ctx.prog_ptr]);
-        anzu::print("Stack: {}\n", format_comma_separated(ctx.stack));
-        anzu::print("Heap: allocated={}\n", ctx.allocator.bytes_allocated());
+    ctx.rom = program.rom;
+    ctx.frame_alignment = program.frame_alignment;
+    ctx.track_allocations = program.track_allocations;
+    try {
+        while (ctx.prog_ptr < program.code.size()) {
+            const auto& op = program.code[ctx.prog_ptr];
+            anzu::print("{:>4} - {}\n", ctx.prog_ptr, op);
+            apply_op(ctx, op);
+            anzu::print("Stack: {}\n", format_comma_separated(ctx.stack));
+            anzu::print("Heap: allocated={}\n", ctx.allocator.bytes_allocated());
+        }
+    } catch (const runtime_error& e) {
+        anzu::print("{}", e.what());
+        std::exit(1);
     }
 
+    print_memo_stats(ctx);
+
     if (ctx.allocator.bytes_allocated() > 0) {
         anzu::print("\n -> Heap Size: {}, fix your memory leak!\n", ctx.allocator.bytes_allocated());
     }
@@ -1,12 +1,34 @@
 #pragma once
 #include "program.hpp"
 #include "allocator.hpp"
+#include "utility/mapped_file.hpp"
 
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 
 namespace anzu {
 
+// The results of a memoised function, keyed by the bytes of the args. When full, the oldest
+// entry is evicted.
+struct memo_cache
+{
+    std::string                                             name;
+    std::unordered_map<std::string, std::vector<std::byte>> results;
+    std::deque<std::string>                                 order;
+
+    std::size_t hits      = 0;
+    std::size_t misses    = 0;
+    std::size_t evictions = 0;
+};
+
 struct runtime_context
 {
     std::size_t prog_ptr = 0;
@@ -17,10 +39,40 @@ struct runtime_context
 
     memory_allocator allocator;
 
+    // The start and size of each live heap allocation, for checking pointers. Only recorded if
+    // track_allocations is set.
+    std::map<std::size_t, std::size_t> allocations;
+    bool                               track_allocations = false;
+
+    // Read-only memory regions. Region 0 is the data segment of the program, the rest are
+    // files mapped by read_file, which stay mapped until the program ends.
+    std::span<const std::byte>                rom;
+    std::vector<std::unique_ptr<mapped_file>> mapped_files;
+
+    // Caches for memoised functions, indexed by id, and the args of the memoised calls that
+    // are in progress.
+    std::vector<memo_cache>  memo_caches;
+    std::vector<std::string> memo_keys;
+
+    // Check every subscript and memory access, even those the compiler did not ask to be
+    // checked. Set when evaluating calls at compile time, where a bad read must not become a
+    // constant.
+    bool check_all = false;
+
+    // Frames start at a multiple of this, which is a power of 2. The padding before a frame is stored in the low bits
+    // of its saved base ptr, which are otherwise zero since every base ptr is aligned.
+    std::size_t frame_alignment = 1;
+
     runtime_context() : allocator{heap} {}
 };
 
 auto run_program(const program& prog) -> void;
 auto run_program_debug(const program& prog) -> void;
 
+// Runs the program from the given op until it reaches the end and returns the final stack, or
+// nullopt if it does not finish within the given number of ops, grows the stack too far or fails
+// a runtime check. Used by the compiler to evaluate calls at compile time.
+auto evaluate(const program& prog, std::size_t start, std::size_t step_budget)
+    -> std::optional<std::vector<std::byte>>;
+
 }
\ No newline at end of file
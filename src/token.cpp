@@ -19,9 +19,15 @@ auto to_string(token_type type) -> std::string
         break; case token_type::name:      { return "name"; };
         break; case token_type::character: { return "character"; };
         break; case token_type::string:    { return "string"; };
+        break; case token_type::i8:        { return "i8"; };
+        break; case token_type::i16:       { return "i16"; };
         break; case token_type::i32:       { return "i32"; };
         break; case token_type::i64:       { return "i64"; };
+        break; case token_type::u8:        { return "u8"; };
+        break; case token_type::u16:       { return "u16"; };
+        break; case token_type::u32:       { return "u32"; };
         break; case token_type::u64:       { return "u64"; };
+        break; case token_type::f32:       { return "f32"; };
         break; case token_type::f64:       { return "f64"; };
         break; default:                    { return "UNKNOWN"; };
     }
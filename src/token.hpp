@@ -14,9 +14,15 @@ enum class token_type
     symbol,
     name,
     character,
+    i8,
+    i16,
     i32,
     i64,
+    u8,
+    u16,
+    u32,
     u64,
+    f32,
     f64,
     string
 };
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace anzu {
+
+// An RAII class that maps an entire file into memory as read-only. If the file could not be
+// opened or mapped, valid() returns false.
+class mapped_file
+{
+    const std::byte* d_data = nullptr;
+    std::size_t      d_size = 0;
+    bool             d_valid = false;
+
+#ifdef _WIN32
+    HANDLE d_file = INVALID_HANDLE_VALUE;
+    HANDLE d_mapping = nullptr;
+#endif
+
+public:
+    explicit mapped_file(const std::string& path)
+    {
+#ifdef _WIN32
+        d_file = CreateFileA(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr
+        );
+        if (d_file == INVALID_HANDLE_VALUE) { return; }
+
+        auto size = LARGE_INTEGER{};
+        if (!GetFileSizeEx(d_file, &size)) { return; }
+        d_size = static_cast<std::size_t>(size.QuadPart);
+        d_valid = true;
+        if (d_size == 0) { return; } // Cannot map an empty file, but it is still valid
+
+        d_mapping = CreateFileMappingA(d_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!d_mapping) { d_valid = false; return; }
+        d_data = static_cast<const std::byte*>(MapViewOfFile(d_mapping, FILE_MAP_READ, 0, 0, 0));
+        d_valid = d_data != nullptr;
+#else
+        const auto fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) { return; }
+
+        struct stat info{};
+        if (fstat(fd, &info) == 0) {
+            d_size = static_cast<std::size_t>(info.st_size);
+            d_valid = true;
+            if (d_size > 0) { // Cannot map an empty file, but it is still valid
+                void* data = mmap(nullptr, d_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                d_valid = data != MAP_FAILED;
+                d_data = d_valid ? static_cast<const std::byte*>(data) : nullptr;
+            }
+        }
+        close(fd); // The mapping keeps its own reference to the file
+#endif
+    }
+
+    ~mapped_file()
+    {
+#ifdef _WIN32
+        if (d_data) { UnmapViewOfFile(d_data); }
+        if (d_mapping) { CloseHandle(d_mapping); }
+        if (d_file != INVALID_HANDLE_VALUE) { CloseHandle(d_file); }
+#else
+        if (d_data) { munmap(const_cast<std::byte*>(d_data), d_size); }
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    auto valid() const -> bool { return d_valid; }
+    auto data() const -> const std::byte* { return d_data; }
+    auto size() const -> std::size_t { return d_size; }
+};
+
+}
\ No newline at end of file
@@ -7,6 +7,12 @@
 
 namespace anzu {
 
+// Rounds the value up to the next multiple of the alignment
+inline auto align_up(std::size_t value, std::size_t alignment) -> std::size_t
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
 inline auto pop_n(std::vector<std::byte>& vec, std::size_t count) -> void
 {
     vec.resize(vec.size() - count);
@@ -10,7 +10,8 @@ auto is_keyword(std::string_view token) -> bool
     static const std::unordered_set<std::string_view> tokens = {
         tk_break, tk_continue, tk_else, tk_false, tk_for, tk_if, tk_in, tk_null, tk_true,
         tk_while, tk_bool, tk_function, tk_return, tk_struct, tk_sizeof, tk_char,
-        tk_i32, tk_i64, tk_u64, tk_f64, tk_new, tk_delete
+        tk_i8, tk_i16, tk_i32, tk_i64, tk_u8, tk_u16, tk_u32, tk_u64, tk_f32, tk_f64, tk_new,
+        tk_delete, tk_inline, tk_memo, tk_soa, tk_vec
     };
     return tokens.contains(token);
 }
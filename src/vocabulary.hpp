@@ -22,11 +22,21 @@ constexpr auto tk_struct    = sv{"struct"};
 constexpr auto tk_sizeof    = sv{"sizeof"};
 constexpr auto tk_new       = sv{"new"};
 constexpr auto tk_delete    = sv{"delete"};
+constexpr auto tk_inline    = sv{"inline"};
+constexpr auto tk_memo      = sv{"memo"};
+constexpr auto tk_soa       = sv{"soa"};
+constexpr auto tk_vec       = sv{"vec"};
 
 // Builtin Types
+constexpr auto tk_i8        = sv{"i8"};
+constexpr auto tk_i16       = sv{"i16"};
 constexpr auto tk_i32       = sv{"i32"};
 constexpr auto tk_i64       = sv{"i64"};
+constexpr auto tk_u8        = sv{"u8"};
+constexpr auto tk_u16       = sv{"u16"};
+constexpr auto tk_u32       = sv{"u32"};
 constexpr auto tk_u64       = sv{"u64"};
+constexpr auto tk_f32       = sv{"f32"};
 constexpr auto tk_f64       = sv{"f64"};
 constexpr auto tk_char      = sv{"char"};
 constexpr auto tk_bool      = sv{"bool"};
@@ -0,0 +1,23 @@
+# Runs an anzu script and compares its output with the expected output, leaving out the lines
+# that report the progress of the interpreter. A script whose first line is '# flags: ...' is
+# run with those flags as well as the level.
+file(STRINGS ${SCRIPT} first_line LIMIT_COUNT 1)
+set(flags "")
+if(first_line MATCHES "^# flags: (.*)$")
+    separate_arguments(flags UNIX_COMMAND "${CMAKE_MATCH_1}")
+endif()
+
+execute_process(
+    COMMAND ${ANZU} ${SCRIPT} run ${LEVEL} ${flags}
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE output
+)
+string(REGEX REPLACE "(^|\n)Loading file [^\n]*" "" output "${output}")
+string(REGEX REPLACE "(^|\n) *->[^\n]*" "" output "${output}")
+string(STRIP "${output}" output)
+
+file(READ ${EXPECTED} expected)
+string(STRIP "${expected}" expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "${SCRIPT} at ${LEVEL} printed:\n${output}\nexpected:\n${expected}")
+endif()